@@ -24,7 +24,13 @@ LOCAL_MODULE := audio.primary.$(TARGET_BOOTLOADER_BOARD_NAME)
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 
 LOCAL_SRC_FILES := \
-	audio_hw.c
+	audio_hw.c \
+	alsa_card.c \
+	audio_parms.c \
+	audio_sched.c \
+	hdmi_audio_utils.c \
+	hdmi_caps_cache.c \
+	uevent_monitor.c
 
 ifneq ($(BOARD_AUDIO_HW_CONFIG_DIR),)
 LOCAL_C_INCLUDES += $(BOARD_AUDIO_HW_CONFIG_DIR)
@@ -35,10 +41,11 @@ endif
 LOCAL_C_INCLUDES += \
 	external/tinyalsa/include \
 	system/media/audio_route/include \
+	$(LOCAL_PATH)/../libpower \
 	$(call include-path-for, audio-utils) \
 	$(call include-path-for, audio-effects)
 
-LOCAL_SHARED_LIBRARIES := liblog libcutils libtinyalsa libaudioutils libaudio-resampler libaudioroute
+LOCAL_SHARED_LIBRARIES := liblog libcutils libhardware libtinyalsa libaudioutils libaudio-resampler libaudioroute
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
@@ -53,7 +60,19 @@ LOCAL_MODULE := audio.hdmi.$(TARGET_BOOTLOADER_BOARD_NAME)
 
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_SRC_FILES := hdmi_audio_hw.c \
-	hdmi_audio_utils.c
+	hdmi_audio_utils.c \
+	hdmi_caps_cache.c \
+	hdmi_iec61937.c \
+	alsa_card.c \
+	audio_parms.c \
+	audio_sched.c \
+	uevent_monitor.c
+
+ifneq ($(BOARD_AUDIO_HW_CONFIG_DIR),)
+LOCAL_C_INCLUDES += $(BOARD_AUDIO_HW_CONFIG_DIR)
+else
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/config
+endif
 
 LOCAL_C_INCLUDES += \
 	external/tinyalsa/include \
@@ -62,6 +81,10 @@ LOCAL_C_INCLUDES += \
 	frameworks/native/include/media/openmax \
         $(DOMX_PATH)/omx_core/inc
 
+ifeq ($(BOARD_HAVE_AUDIO_FORMAT_DTS),true)
+LOCAL_CFLAGS += -DHAVE_AUDIO_FORMAT_DTS
+endif
+
 LOCAL_SHARED_LIBRARIES := liblog libcutils libtinyalsa libaudioutils libdl
 LOCAL_MODULE_TAGS := optional
 
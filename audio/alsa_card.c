@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "alsa_card"
+/* #define LOG_NDEBUG 0 */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "alsa_card.h"
+#include "uevent_monitor.h"
+
+#define ASOUND_CARDS_PATH "/proc/asound/cards"
+#define MAX_CARDS 8 /* SNDRV_CARDS */
+
+struct alsa_card {
+    int num;
+    char id[16];
+    char name[32];
+};
+
+static pthread_mutex_t cards_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cards_once = PTHREAD_ONCE_INIT;
+static struct alsa_card cards[MAX_CARDS];
+static int num_cards;
+static bool cards_valid;
+static bool cards_monitored;
+
+static void sound_card_event(const struct uevent *event, void *arg __unused)
+{
+    if (strcmp(event->subsystem, "sound") ||
+        (strcmp(event->action, "add") && strcmp(event->action, "remove")))
+        return;
+
+    ALOGV("sound card %s %s, dropping cached card list", event->action, event->path);
+    pthread_mutex_lock(&cards_lock);
+    cards_valid = false;
+    pthread_mutex_unlock(&cards_lock);
+}
+
+static void cards_monitor_start(void)
+{
+    cards_monitored = !uevent_monitor_add(sound_card_event, NULL);
+}
+
+/*
+ * Each card takes two lines:
+ *  " 1 [OMAP4HDMI      ]: OMAP4HDMI - OMAP4HDMI"
+ *  "                      OMAP4HDMI"
+ */
+static void read_cards(void)
+{
+    char line[128];
+    struct alsa_card *card;
+    FILE *f;
+
+    num_cards = 0;
+
+    f = fopen(ASOUND_CARDS_PATH, "r");
+    if (!f) {
+        ALOGE("cannot open %s", ASOUND_CARDS_PATH);
+        return;
+    }
+
+    while (num_cards < MAX_CARDS && fgets(line, sizeof(line), f)) {
+        card = &cards[num_cards];
+        card->name[0] = '\0';
+        if (sscanf(line, "%d [%15[^] ] ]: %*s - %31[^\n]",
+                   &card->num, card->id, card->name) < 2)
+            continue;
+        ALOGV("card %d: id '%s' name '%s'", card->num, card->id, card->name);
+        num_cards++;
+    }
+
+    fclose(f);
+}
+
+int alsa_card_find(const char *name, int fallback)
+{
+    int card = fallback;
+    int i;
+
+    pthread_once(&cards_once, cards_monitor_start);
+
+    pthread_mutex_lock(&cards_lock);
+
+    if (!cards_valid || !cards_monitored) {
+        read_cards();
+        cards_valid = true;
+    }
+
+    for (i = 0; i < num_cards; i++) {
+        if (!strcmp(cards[i].id, name) || !strcmp(cards[i].name, name)) {
+            card = cards[i].num;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&cards_lock);
+
+    ALOGW_IF(i == num_cards, "no ALSA card '%s', using card %d", name, fallback);
+
+    return card;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALSA_CARD_H
+#define ALSA_CARD_H
+
+/*
+ * ALSA card lookup by name. Card numbers depend on probe order, so e.g.
+ * a USB DAC present at boot can take the slot the HDMI card usually gets.
+ *
+ * /proc/asound/cards is parsed on first use and cached until a sound card
+ * is added or removed (seen through the uevent monitor). If uevents cannot
+ * be monitored, the file is parsed on every lookup.
+ */
+
+/*
+ * Returns the number of the card whose id or short name is name, or
+ * fallback if there is no such card.
+ */
+int alsa_card_find(const char *name, int fallback);
+
+#endif /* ALSA_CARD_H */
@@ -22,13 +22,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <cutils/log.h>
 #include <cutils/properties.h>
-#include <cutils/str_parms.h>
 
 #include <hardware/audio.h>
 #include <hardware/hardware.h>
+#include <hardware/power.h>
 
 #include <system/audio.h>
 
@@ -41,9 +42,18 @@
 
 #include <audio_route/audio_route.h>
 
+#include "alsa_card.h"
+#include "audio_parms.h"
+#include "audio_sched.h"
+#include "hdmi_audio_hal.h"
+#include "omap_power_hints.h"
+
 /* minimum sleep time in out_write() when write threshold is not reached */
 #define MIN_WRITE_SLEEP_US      2000
 
+/* size of the replies built by the get_parameters() functions */
+#define PARAMETERS_REPLY_SIZE   256
+
 #include <audio_hw_config.h>
 
 enum {
@@ -64,10 +74,40 @@ struct audio_device {
     int orientation;
     bool screen_off;
 
+    struct power_module *power;
+    bool low_power_playback; /* OMAP_POWER_HINT_AUDIO_LOW_POWER is on */
+
     struct stream_out *active_out;
     struct stream_in *active_in;
 };
 
+/*
+ * Second sink for speaker+HDMI duplication. The mix written to the main
+ * PCM is also queued, resampled if the HDMI sink runs at another rate,
+ * in a ring that a writer thread drains into the HDMI PCM. Each sink is
+ * paced by its own clock, so a stall on one does not hold up the other;
+ * what does not fit in the ring is dropped.
+ */
+struct hdmi_dup {
+    struct pcm *pcm;
+    struct pcm_config config;
+    struct resampler_itfe *resampler;
+    int16_t *rs_buffer;
+    size_t rs_frames;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool exit;
+    int16_t *ring;
+    size_t ring_frames;
+    uint64_t rd;         /* frames read by the writer thread */
+    uint64_t wr;         /* frames queued by out_write() */
+    unsigned int dropped; /* frames that did not fit in the ring */
+    unsigned int errors;
+    struct audio_sched sched;
+};
+
 struct stream_out {
     struct audio_stream_out stream;
 
@@ -85,6 +125,10 @@ struct stream_out {
     int cur_write_threshold;
     int buffer_type;
 
+    struct audio_sched sched;
+
+    struct hdmi_dup *dup; /* HDMI duplication, when routed to HDMI and more */
+
     struct audio_device *dev;
 };
 
@@ -104,6 +148,12 @@ struct stream_in {
     size_t frames_in;
     int read_status;
 
+    /* synthetic silence while the mic is muted: the capture PCM is closed
+     * and in_read() is paced from CLOCK_MONOTONIC instead */
+    bool muted;
+    struct timespec mute_start;
+    uint64_t mute_frames;
+
     struct audio_device *dev;
 };
 
@@ -185,6 +235,26 @@ static void select_devices(struct audio_device *adev)
     ALOGV("out_devices == 0x%8x, in_devices == 0x%8x", out_devices, in_devices);
 }
 
+static void power_hint(struct audio_device *adev, int hint, void *data)
+{
+    if (adev->power && adev->power->powerHint)
+        adev->power->powerHint(adev->power, hint, data);
+}
+
+/* must be called with hw device mutex locked */
+static void set_low_power_playback(struct audio_device *adev, bool on)
+{
+    int data = on;
+
+    if (on == adev->low_power_playback)
+        return;
+
+    adev->low_power_playback = on;
+    power_hint(adev, OMAP_POWER_HINT_AUDIO_LOW_POWER, &data);
+}
+
+static void hdmi_dup_close(struct hdmi_dup *dup);
+
 /* must be called with hw device and output stream mutexes locked */
 static void do_out_standby(struct stream_out *out)
 {
@@ -202,6 +272,12 @@ static void do_out_standby(struct stream_out *out)
             free(out->buffer);
             out->buffer = NULL;
         }
+        if (out->dup) {
+            hdmi_dup_close(out->dup);
+            out->dup = NULL;
+        }
+        audio_sched_reset(&out->sched);
+        set_low_power_playback(adev, false);
         out->standby = true;
     }
 }
@@ -227,6 +303,269 @@ static void do_in_standby(struct stream_in *in)
     }
 }
 
+static int out_buffer_type(struct audio_device *adev)
+{
+    return (adev->screen_off && !adev->active_in) ?
+            OUT_BUFFER_TYPE_LONG : OUT_BUFFER_TYPE_SHORT;
+}
+
+/* must be called with hw device and output stream mutexes locked */
+static void set_out_buffer_type(struct stream_out *out, int buffer_type)
+{
+    size_t period_count;
+
+    if (buffer_type == out->buffer_type)
+        return;
+
+    /* deep buffering means steady screen-off playback: let the power
+     * HAL cap the CPU frequency until it ends */
+    set_low_power_playback(out->dev, buffer_type == OUT_BUFFER_TYPE_LONG);
+
+    if (buffer_type == OUT_BUFFER_TYPE_LONG)
+        period_count = pcm_config_out_lp.period_count;
+    else
+        period_count = pcm_config_out.period_count;
+
+    out->write_threshold = out->pcm_config.period_size * period_count;
+    /* reset current threshold if exiting standby, otherwise out_write()
+     * walks cur_write_threshold towards the new target */
+    if (out->buffer_type == OUT_BUFFER_TYPE_UNKNOWN)
+        out->cur_write_threshold = out->write_threshold;
+    out->buffer_type = buffer_type;
+}
+
+/*
+ * Push a change of screen state or input activity to the active output.
+ * Taking the output mutex waits for any out_write() in progress, so the
+ * new threshold takes effect at a period boundary.
+ * Must be called with hw device mutex locked, and without the output
+ * stream mutex. Do not change buffer size when routed to SCO device.
+ */
+static void update_out_buffer_type(struct audio_device *adev)
+{
+    struct stream_out *out = adev->active_out;
+
+    if (!out || (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO))
+        return;
+
+    pthread_mutex_lock(&out->lock);
+    set_out_buffer_type(out, out_buffer_type(adev));
+    pthread_mutex_unlock(&out->lock);
+}
+
+/*
+ * Returns the HDMI PCM rate for content at rate: the sink rate that needs
+ * no resampling if there is one, else the pcm_config_hdmi default.
+ */
+static unsigned int hdmi_out_rate(unsigned int rate)
+{
+    hdmi_audio_caps_t caps;
+
+    if (hdmi_get_audio_caps(&caps))
+        return pcm_config_hdmi.rate;
+
+    return hdmi_caps_select_rate(&caps, rate, pcm_config_hdmi.channels);
+}
+
+static unsigned int hdmi_card(void)
+{
+#ifdef PCM_CARD_HDMI_NAME
+    return alsa_card_find(PCM_CARD_HDMI_NAME, PCM_CARD_HDMI);
+#else
+    return PCM_CARD_HDMI;
+#endif
+}
+
+/*
+ * HDMI alone takes over the output PCM; HDMI together with any other
+ * device is duplicated to a second PCM.
+ */
+enum {
+    OUT_HDMI_NONE,
+    OUT_HDMI_ONLY,
+    OUT_HDMI_DUP,
+};
+
+static int out_hdmi_mode(unsigned int devices)
+{
+    if (!(devices & AUDIO_DEVICE_OUT_AUX_DIGITAL))
+        return OUT_HDMI_NONE;
+    return (devices & ~AUDIO_DEVICE_OUT_AUX_DIGITAL) ? OUT_HDMI_DUP : OUT_HDMI_ONLY;
+}
+
+static void *hdmi_dup_thread(void *arg)
+{
+    struct hdmi_dup *dup = (struct hdmi_dup *)arg;
+    const size_t channels = dup->config.channels;
+    size_t frames, pos;
+
+    audio_sched_apply_current(&dup->sched);
+
+    pthread_mutex_lock(&dup->lock);
+    for (;;) {
+        while (!dup->exit && dup->rd == dup->wr)
+            pthread_cond_wait(&dup->cond, &dup->lock);
+        if (dup->exit)
+            break;
+
+        /* the producer never touches queued frames, so write them unlocked */
+        pos = dup->rd % dup->ring_frames;
+        frames = dup->wr - dup->rd;
+        if (frames > dup->ring_frames - pos)
+            frames = dup->ring_frames - pos;
+        if (frames > dup->config.period_size)
+            frames = dup->config.period_size;
+        pthread_mutex_unlock(&dup->lock);
+
+        if (pcm_write(dup->pcm, dup->ring + pos * channels,
+                      frames * channels * sizeof(int16_t)) && !dup->errors++)
+            ALOGW("HDMI duplication write failed: %s", pcm_get_error(dup->pcm));
+
+        pthread_mutex_lock(&dup->lock);
+        dup->rd += frames;
+    }
+    pthread_mutex_unlock(&dup->lock);
+
+    return NULL;
+}
+
+/* Opens the HDMI sink for a stream at rate. Returns NULL on failure. */
+static struct hdmi_dup *hdmi_dup_open(unsigned int rate)
+{
+    struct hdmi_dup *dup;
+    unsigned int card = hdmi_card();
+    int ret;
+
+    dup = (struct hdmi_dup *)calloc(1, sizeof(struct hdmi_dup));
+    if (!dup)
+        return NULL;
+
+    dup->config = pcm_config_hdmi;
+    dup->config.rate = hdmi_out_rate(rate);
+    pthread_mutex_init(&dup->lock, NULL);
+    pthread_cond_init(&dup->cond, NULL);
+    audio_sched_init(&dup->sched, AUDIO_SCHED_HDMI);
+
+    ALOGD("HDMI duplication: pcm_open(%d, %d, rate=%u)", card, PCM_DEVICE_DEFAULT_OUT,
+          dup->config.rate);
+    dup->pcm = pcm_open(card, PCM_DEVICE_DEFAULT_OUT, PCM_OUT, &dup->config);
+    if (!dup->pcm || !pcm_is_ready(dup->pcm)) {
+        ALOGE("HDMI duplication: pcm_open failed: %s", pcm_get_error(dup->pcm));
+        goto fail;
+    }
+
+    if (dup->config.rate != rate) {
+        if (create_resampler(rate, dup->config.rate, dup->config.channels,
+                             RESAMPLER_QUALITY_DEFAULT, NULL, &dup->resampler))
+            goto fail;
+        dup->rs_frames = (pcm_config_out.period_size * dup->config.rate) / rate + 1;
+        dup->rs_buffer = (int16_t *)malloc(dup->rs_frames * dup->config.channels *
+                                           sizeof(int16_t));
+        if (!dup->rs_buffer)
+            goto fail;
+    }
+
+    dup->ring_frames = dup->config.period_size * dup->config.period_count;
+    dup->ring = (int16_t *)malloc(dup->ring_frames * dup->config.channels * sizeof(int16_t));
+    if (!dup->ring)
+        goto fail;
+
+    ret = pthread_create(&dup->thread, NULL, hdmi_dup_thread, dup);
+    if (ret) {
+        ALOGE("HDMI duplication: cannot start writer thread: %s", strerror(ret));
+        goto fail;
+    }
+
+    return dup;
+
+fail:
+    if (dup->pcm)
+        pcm_close(dup->pcm);
+    if (dup->resampler)
+        release_resampler(dup->resampler);
+    free(dup->rs_buffer);
+    free(dup->ring);
+    pthread_cond_destroy(&dup->cond);
+    pthread_mutex_destroy(&dup->lock);
+    free(dup);
+    return NULL;
+}
+
+static void hdmi_dup_close(struct hdmi_dup *dup)
+{
+    pthread_mutex_lock(&dup->lock);
+    dup->exit = true;
+    pthread_cond_signal(&dup->cond);
+    pthread_mutex_unlock(&dup->lock);
+    pthread_join(dup->thread, NULL);
+
+    ALOGW_IF(dup->dropped, "HDMI duplication dropped %u frames", dup->dropped);
+
+    pcm_close(dup->pcm);
+    if (dup->resampler)
+        release_resampler(dup->resampler);
+    free(dup->rs_buffer);
+    free(dup->ring);
+    pthread_cond_destroy(&dup->cond);
+    pthread_mutex_destroy(&dup->lock);
+    free(dup);
+}
+
+/* Queues frames of the mix for the HDMI sink, without blocking on it */
+static void hdmi_dup_queue(struct hdmi_dup *dup, const int16_t *buffer, size_t frames)
+{
+    const size_t channels = dup->config.channels;
+    size_t room, pos, n;
+
+    pthread_mutex_lock(&dup->lock);
+
+    room = dup->ring_frames - (size_t)(dup->wr - dup->rd);
+    if (frames > room) {
+        dup->dropped += frames - room;
+        frames = room;
+    }
+
+    while (frames) {
+        pos = dup->wr % dup->ring_frames;
+        n = dup->ring_frames - pos;
+        if (n > frames)
+            n = frames;
+        memcpy(dup->ring + pos * channels, buffer, n * channels * sizeof(int16_t));
+        dup->wr += n;
+        buffer += n * channels;
+        frames -= n;
+    }
+
+    pthread_cond_signal(&dup->cond);
+    pthread_mutex_unlock(&dup->lock);
+}
+
+/* Fans frames of the mix out to the HDMI sink, at the sink rate */
+static void hdmi_dup_write(struct hdmi_dup *dup, int16_t *buffer, size_t frames)
+{
+    const size_t channels = dup->config.channels;
+    size_t in_frames, out_frames;
+
+    if (!dup->resampler) {
+        hdmi_dup_queue(dup, buffer, frames);
+        return;
+    }
+
+    while (frames) {
+        in_frames = frames;
+        if (in_frames > pcm_config_out.period_size)
+            in_frames = pcm_config_out.period_size;
+        out_frames = dup->rs_frames;
+        dup->resampler->resample_from_input(dup->resampler, buffer, &in_frames,
+                                            dup->rs_buffer, &out_frames);
+        if (!in_frames)
+            break;
+        hdmi_dup_queue(dup, dup->rs_buffer, out_frames);
+        buffer += in_frames * channels;
+        frames -= in_frames;
+    }
+}
+
 /* must be called with hw device and output stream mutexes locked */
 static int start_output_stream(struct stream_out *out)
 {
@@ -235,6 +574,9 @@ static int start_output_stream(struct stream_out *out)
     unsigned int card = PCM_CARD_DEFAULT;
     int ret;
 
+    /* get the CPU up to speed for pcm_open() and resampler setup */
+    power_hint(adev, OMAP_POWER_HINT_AUDIO_START, NULL);
+
     /*
      * Due to the lack of sample rate converters in the SoC,
      * it greatly simplifies things to have only the main
@@ -247,15 +589,22 @@ static int start_output_stream(struct stream_out *out)
         out->pcm_config = pcm_config_sco;
     } else {
 #endif
-    if (adev->out_device & AUDIO_DEVICE_OUT_AUX_DIGITAL) {
-        card = PCM_CARD_HDMI;
+    if (out_hdmi_mode(adev->out_device) == OUT_HDMI_ONLY) {
+        card = hdmi_card();
         out->pcm_config = pcm_config_hdmi;
+        out->pcm_config.rate = hdmi_out_rate(out_get_sample_rate(&out->stream.common));
     } else {
+        /*
+         * Size the ring for the deep buffer even when the screen is on,
+         * so that a screen-off event only has to raise the write
+         * threshold instead of reopening the PCM.
+         */
         out->pcm_config = pcm_config_out;
-        out->buffer_type = OUT_BUFFER_TYPE_UNKNOWN;
+        out->pcm_config.period_count = pcm_config_out_lp.period_count;
         if (adev->screen_off)
             device = PCM_DEVICE_MM_LP;
     }
+    out->buffer_type = OUT_BUFFER_TYPE_UNKNOWN;
 
     /*
      * All open PCMs can only use a single group of rates at once:
@@ -304,7 +653,17 @@ static int start_output_stream(struct stream_out *out)
         out->buffer = malloc(pcm_frames_to_bytes(out->pcm, out->buffer_frames));
     }
 
+    /* Losing the HDMI copy must not take the speaker down with it */
+    if (out_hdmi_mode(adev->out_device) == OUT_HDMI_DUP) {
+        out->dup = hdmi_dup_open(out_get_sample_rate(&out->stream.common));
+        if (!out->dup)
+            ALOGE("HDMI duplication unavailable, playing on %#x only",
+                  adev->out_device & ~AUDIO_DEVICE_OUT_AUX_DIGITAL);
+    }
+
     adev->active_out = out;
+    if (!(adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO))
+        set_out_buffer_type(out, out_buffer_type(adev));
 
     return 0;
 }
@@ -317,6 +676,8 @@ static int start_input_stream(struct stream_in *in)
     unsigned int device;
     int ret;
 
+    power_hint(adev, OMAP_POWER_HINT_AUDIO_START, NULL);
+
     /*
      * Due to the lack of sample rate converters in the SoC,
      * it greatly simplifies things to have only the main
@@ -382,6 +743,7 @@ static int start_input_stream(struct stream_in *in)
     in->frames_in = 0;
 
     adev->active_in = in;
+    update_out_buffer_type(adev);
 
     return 0;
 }
@@ -539,8 +901,19 @@ static int out_standby(struct audio_stream *stream)
     return 0;
 }
 
-static int out_dump(const struct audio_stream *stream __unused, int fd __unused)
+static int out_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_out *out = (struct stream_out *)stream;
+
+    dprintf(fd, "      late writes: %u of %u\n",
+            out->sched.missed, out->sched.writes);
+    /* the sink goes away on standby */
+    if (!pthread_mutex_trylock(&out->lock)) {
+        if (out->dup)
+            dprintf(fd, "      HDMI duplication: %u frames dropped, %u write errors\n",
+                    out->dup->dropped, out->dup->errors);
+        pthread_mutex_unlock(&out->lock);
+    }
     return 0;
 }
 
@@ -548,26 +921,26 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
 {
     struct stream_out *out = (struct stream_out *)stream;
     struct audio_device *adev = out->dev;
-    struct str_parms *parms;
-    char value[32];
+    struct audio_parms parms;
     int ret;
     unsigned int val;
 
     ALOGD("out_set_parameters::kvpairs == %s", kvpairs);
 
-    parms = str_parms_create_str(kvpairs);
+    audio_parms_parse(&parms, kvpairs);
 
-    ret = str_parms_get_str(parms, AUDIO_PARAMETER_STREAM_ROUTING, value, sizeof(value));
-    pthread_mutex_lock(&adev->lock);
-    if (ret >= 0) {
-        val = atoi(value);
-        if ((adev->out_device != val) && (val != 0)) {
+    ret = audio_parms_get_uint(&parms, AUDIO_PARM_ROUTING, &val);
+    if (ret == 0 && val != 0 && val != adev->out_device) {
+        pthread_mutex_lock(&adev->lock);
+        if (adev->out_device != val) {
             /*
              * If SCO is turned on/off, we need to put audio into standby
-             * because SCO uses a different PCM.
+             * because SCO uses a different PCM. The same goes for HDMI
+             * being added, removed or duplicated.
              */
-            if ((val & AUDIO_DEVICE_OUT_ALL_SCO) ^
-                    (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO)) {
+            if (((val & AUDIO_DEVICE_OUT_ALL_SCO) ^
+                    (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO)) ||
+                    out_hdmi_mode(val) != out_hdmi_mode(adev->out_device)) {
                 pthread_mutex_lock(&out->lock);
                 do_out_standby(out);
                 pthread_mutex_unlock(&out->lock);
@@ -577,16 +950,35 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
             adev->out_device = val;
             select_devices(adev);
         }
+        pthread_mutex_unlock(&adev->lock);
     }
-    pthread_mutex_unlock(&adev->lock);
 
-    str_parms_destroy(parms);
     return ret;
 }
 
-static char * out_get_parameters(const struct audio_stream *stream __unused, const char *keys __unused)
+static char * out_get_parameters(const struct audio_stream *stream, const char *keys)
 {
-    return strdup("");
+    struct stream_out *out = (struct stream_out *)stream;
+    struct audio_parms query;
+    char reply[PARAMETERS_REPLY_SIZE] = "";
+
+    /* answered from cached state, without taking any lock */
+    audio_parms_parse(&query, keys);
+
+    if (audio_parms_has(&query, AUDIO_PARM_ROUTING))
+        audio_parms_reply_uint(reply, sizeof(reply), AUDIO_PARM_ROUTING,
+                               out->dev->out_device);
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_FORMATS))
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_FORMATS,
+                              "AUDIO_FORMAT_PCM_16_BIT");
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_CHANNELS))
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_CHANNELS,
+                              "AUDIO_CHANNEL_OUT_STEREO");
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_SAMPLING_RATES))
+        audio_parms_reply_uint(reply, sizeof(reply), AUDIO_PARM_SUP_SAMPLING_RATES,
+                               out_get_sample_rate(stream));
+
+    return strdup(reply);
 }
 
 static uint32_t out_get_latency(const struct audio_stream_out *stream)
@@ -623,10 +1015,11 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
     int16_t *in_buffer = (int16_t *)buffer;
     size_t in_frames = bytes / frame_size;
     size_t out_frames;
-    int buffer_type;
     int kernel_frames;
     bool sco_on;
 
+    audio_sched_apply_current(&out->sched);
+
 do_over:
     /*
      * acquiring hw device mutex systematically is useful if a low
@@ -644,27 +1037,12 @@ do_over:
         }
         out->standby = false;
     }
-    buffer_type = (adev->screen_off && !adev->active_in) ?
-            OUT_BUFFER_TYPE_LONG : OUT_BUFFER_TYPE_SHORT;
     sco_on = (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO);
     pthread_mutex_unlock(&adev->lock);
 
-    /* detect changes in screen ON/OFF state and adapt buffer size
-     * if needed. Do not change buffer size when routed to SCO device. */
-    if (!sco_on && (buffer_type != out->buffer_type)) {
-        size_t period_count;
-
-        if (buffer_type == OUT_BUFFER_TYPE_LONG)
-            period_count = pcm_config_out_lp.period_count;
-        else
-            period_count = pcm_config_out.period_count;
-
-        out->write_threshold = out->pcm_config.period_size * period_count;
-        /* reset current threshold if exiting standby */
-        if (out->buffer_type == OUT_BUFFER_TYPE_UNKNOWN)
-            out->cur_write_threshold = out->write_threshold;
-        out->buffer_type = buffer_type;
-    }
+    /* Same mix to HDMI, before it is reshaped for the main PCM */
+    if (out->dup)
+        hdmi_dup_write(out->dup, in_buffer, in_frames);
 
     /* Reduce number of channels, if necessary */
     if (audio_channel_count_from_out_mask(out_get_channels(&stream->common)) >
@@ -757,6 +1135,10 @@ do_over:
     }
     if (ret == 0) {
         out->written += out_frames;
+        /* late if the frames kept queued have run out since last write */
+        if (!sco_on)
+            audio_sched_check_deadline(&out->sched, (uint32_t)
+                    (((int64_t)out->cur_write_threshold * 1000000) / out->pcm_config.rate));
     }
 
 exit:
@@ -845,6 +1227,9 @@ static int in_standby(struct audio_stream *stream)
     pthread_mutex_lock(&in->dev->lock);
     pthread_mutex_lock(&in->lock);
     do_in_standby(in);
+    /* restart the silence clock on the next read if still muted */
+    in->muted = false;
+    update_out_buffer_type(in->dev);
     pthread_mutex_unlock(&in->lock);
     pthread_mutex_unlock(&in->dev->lock);
 
@@ -860,21 +1245,19 @@ static int in_set_parameters(struct audio_stream *stream, const char *kvpairs)
 {
     struct stream_in *in = (struct stream_in *)stream;
     struct audio_device *adev = in->dev;
-    struct str_parms *parms;
-    char value[32];
+    struct audio_parms parms;
     int ret;
-    unsigned int val;
+    unsigned int val = 0;
 
     ALOGD("in_set_parameters::kvpairs == %s", kvpairs);
 
-    parms = str_parms_create_str(kvpairs);
+    audio_parms_parse(&parms, kvpairs);
 
-    ret = str_parms_get_str(parms, AUDIO_PARAMETER_STREAM_ROUTING,
-                            value, sizeof(value));
-    pthread_mutex_lock(&adev->lock);
-    if (ret >= 0) {
-        val = atoi(value) & ~AUDIO_DEVICE_BIT_IN;
-        if ((adev->in_device != val) && (val != 0)) {
+    ret = audio_parms_get_uint(&parms, AUDIO_PARM_ROUTING, &val);
+    val &= ~AUDIO_DEVICE_BIT_IN;
+    if (ret == 0 && val != 0 && val != adev->in_device) {
+        pthread_mutex_lock(&adev->lock);
+        if (adev->in_device != val) {
             /*
              * If SCO is turned on/off, we need to put audio into standby
              * because SCO uses a different PCM.
@@ -883,6 +1266,7 @@ static int in_set_parameters(struct audio_stream *stream, const char *kvpairs)
                     (adev->in_device & AUDIO_DEVICE_IN_ALL_SCO)) {
                 pthread_mutex_lock(&in->lock);
                 do_in_standby(in);
+                update_out_buffer_type(adev);
                 pthread_mutex_unlock(&in->lock);
             }
 
@@ -890,17 +1274,36 @@ static int in_set_parameters(struct audio_stream *stream, const char *kvpairs)
             adev->in_device = val;
             select_devices(adev);
         }
+        pthread_mutex_unlock(&adev->lock);
     }
-    pthread_mutex_unlock(&adev->lock);
 
-    str_parms_destroy(parms);
     return ret;
 }
 
-static char * in_get_parameters(const struct audio_stream *stream __unused,
-                                const char *keys __unused)
+static char * in_get_parameters(const struct audio_stream *stream,
+                                const char *keys)
 {
-    return strdup("");
+    struct stream_in *in = (struct stream_in *)stream;
+    struct audio_parms query;
+    char reply[PARAMETERS_REPLY_SIZE] = "";
+
+    /* answered from cached state, without taking any lock */
+    audio_parms_parse(&query, keys);
+
+    if (audio_parms_has(&query, AUDIO_PARM_ROUTING))
+        audio_parms_reply_uint(reply, sizeof(reply), AUDIO_PARM_ROUTING,
+                               in->dev->in_device | AUDIO_DEVICE_BIT_IN);
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_FORMATS))
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_FORMATS,
+                              "AUDIO_FORMAT_PCM_16_BIT");
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_CHANNELS))
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_CHANNELS,
+                              "AUDIO_CHANNEL_IN_MONO");
+    if (audio_parms_has(&query, AUDIO_PARM_SAMPLING_RATE))
+        audio_parms_reply_uint(reply, sizeof(reply), AUDIO_PARM_SAMPLING_RATE,
+                               in_get_sample_rate(stream));
+
+    return strdup(reply);
 }
 
 static int in_set_gain(struct audio_stream_in *stream __unused, float gain __unused)
@@ -908,6 +1311,54 @@ static int in_set_gain(struct audio_stream_in *stream __unused, float gain __unu
     return 0;
 }
 
+/* must be called with input stream mutex locked */
+static void in_read_muted(struct stream_in *in, void *buffer, size_t bytes,
+                          size_t frames)
+{
+    uint32_t rate = in_get_sample_rate(&in->stream.common);
+    struct timespec now;
+    struct timespec deadline;
+    uint64_t ns;
+
+    memset(buffer, 0, bytes);
+
+    /*
+     * Deliver silence at the rate the capture PCM would: each buffer is
+     * released at mute_start + frames delivered / rate. Whole seconds are
+     * folded back into mute_start so the frame count cannot overflow on
+     * long muted calls.
+     */
+    in->mute_frames += frames;
+    if (in->mute_frames >= rate) {
+        in->mute_start.tv_sec += in->mute_frames / rate;
+        in->mute_frames %= rate;
+    }
+
+    ns = in->mute_frames * 1000000000ULL / rate;
+    deadline.tv_sec = in->mute_start.tv_sec + ns / 1000000000;
+    deadline.tv_nsec = in->mute_start.tv_nsec + ns % 1000000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    /*
+     * If the reader fell behind by more than one buffer (e.g. it stopped
+     * reading without going to standby), restart the clock rather than
+     * returning a burst of buffers immediately, as an overrun would.
+     */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = frames * 1000000000ULL / rate;
+    if ((now.tv_sec - deadline.tv_sec) * 1000000000LL +
+            (now.tv_nsec - deadline.tv_nsec) > (int64_t)ns) {
+        in->mute_start = now;
+        in->mute_frames = 0;
+        return;
+    }
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+}
+
 static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
                        size_t bytes)
 {
@@ -924,6 +1375,29 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
      */
     pthread_mutex_lock(&adev->lock);
     pthread_mutex_lock(&in->lock);
+
+    /*
+     * When the mic is muted, release the capture PCM altogether instead
+     * of reading it and zeroing the result; it is reopened on the first
+     * read after unmute.
+     */
+    if (adev->mic_mute != in->muted) {
+        in->muted = adev->mic_mute;
+        if (in->muted) {
+            do_in_standby(in);
+            update_out_buffer_type(adev);
+            clock_gettime(CLOCK_MONOTONIC, &in->mute_start);
+            in->mute_frames = 0;
+        }
+    }
+
+    if (in->muted) {
+        pthread_mutex_unlock(&adev->lock);
+        in_read_muted(in, buffer, bytes, frames_rq);
+        pthread_mutex_unlock(&in->lock);
+        return bytes;
+    }
+
     if (in->standby) {
         ret = start_input_stream(in);
         if (ret == 0)
@@ -958,13 +1432,6 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     if (ret > 0)
         ret = 0;
 
-    /*
-     * Instead of writing zeroes here, we could trust the hardware
-     * to always provide zeroes when muted.
-     */
-    if (ret == 0 && adev->mic_mute)
-        memset(buffer, 0, bytes);
-
 exit:
     if (ret < 0)
         usleep(bytes * 1000000 / audio_stream_in_frame_size(stream) /
@@ -995,7 +1462,7 @@ static int in_remove_audio_effect(const struct audio_stream *stream __unused,
 static int adev_open_output_stream(struct audio_hw_device *dev,
                                    audio_io_handle_t handle __unused,
                                    audio_devices_t devices,
-                                   audio_output_flags_t flags __unused,
+                                   audio_output_flags_t flags,
                                    struct audio_config *config,
                                    struct audio_stream_out **stream_out,
                                    const char *address __unused)
@@ -1031,6 +1498,13 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
 
     out->dev = adev;
 
+    if (flags & AUDIO_OUTPUT_FLAG_FAST)
+        audio_sched_init(&out->sched, AUDIO_SCHED_FAST);
+    else if (flags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER)
+        audio_sched_init(&out->sched, AUDIO_SCHED_DEEP_BUFFER);
+    else
+        audio_sched_init(&out->sched, AUDIO_SCHED_PRIMARY);
+
     pthread_mutex_lock(&adev->lock);
     adev->out_device &= ~AUDIO_DEVICE_OUT_ALL;
     adev->out_device |= devices;
@@ -1059,32 +1533,34 @@ static void adev_close_output_stream(struct audio_hw_device *dev __unused,
     free(stream);
 }
 
+static const char * const orientation_names[] = {
+    [ORIENTATION_LANDSCAPE] = "landscape",
+    [ORIENTATION_PORTRAIT] = "portrait",
+    [ORIENTATION_SQUARE] = "square",
+    [ORIENTATION_UNDEFINED] = "undefined",
+};
+
 static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
 {
     struct audio_device *adev = (struct audio_device *)dev;
-    struct str_parms *parms;
-    char *str;
-    char value[32];
-    int ret;
+    struct audio_parms parms;
+    int orientation = ORIENTATION_UNDEFINED;
+    int ret = -ENOENT;
 
     ALOGD("adev_set_parameters::kvpairs == %s", kvpairs);
 
-    parms = str_parms_create_str(kvpairs);
-    ret = str_parms_get_str(parms, "orientation", value, sizeof(value));
-    if (ret >= 0) {
-        int orientation;
+    /* parse once, outside the lock, and only lock if something changes */
+    audio_parms_parse(&parms, kvpairs);
 
-        if (strcmp(value, "landscape") == 0)
-            orientation = ORIENTATION_LANDSCAPE;
-        else if (strcmp(value, "portrait") == 0)
-            orientation = ORIENTATION_PORTRAIT;
-        else if (strcmp(value, "square") == 0)
-            orientation = ORIENTATION_SQUARE;
-        else
-            orientation = ORIENTATION_UNDEFINED;
+    if (audio_parms_has(&parms, AUDIO_PARM_ORIENTATION)) {
+        for (orientation = ORIENTATION_LANDSCAPE;
+                orientation < ORIENTATION_UNDEFINED; orientation++)
+            if (audio_parms_value_is(&parms, AUDIO_PARM_ORIENTATION,
+                                     orientation_names[orientation]))
+                break;
 
-        pthread_mutex_lock(&adev->lock);
         if (orientation != adev->orientation) {
+            pthread_mutex_lock(&adev->lock);
             adev->orientation = orientation;
             /*
              * Orientation changes can occur with the input device
@@ -1094,26 +1570,46 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
              * other input parameter is changed.
              */
             select_devices(adev);
+            pthread_mutex_unlock(&adev->lock);
         }
-        pthread_mutex_unlock(&adev->lock);
     }
 
-    ret = str_parms_get_str(parms, "screen_state", value, sizeof(value));
-    if (ret >= 0) {
-        if (strcmp(value, AUDIO_PARAMETER_VALUE_ON) == 0)
-            adev->screen_off = false;
-        else
-            adev->screen_off = true;
+    if (audio_parms_has(&parms, AUDIO_PARM_SCREEN_STATE)) {
+        bool screen_off = !audio_parms_value_is(&parms, AUDIO_PARM_SCREEN_STATE,
+                                                AUDIO_PARAMETER_VALUE_ON);
+
+        ret = 0;
+        pthread_mutex_lock(&adev->lock);
+        if (screen_off != adev->screen_off) {
+            adev->screen_off = screen_off;
+            /* deepen or shorten the active output's buffer right away */
+            update_out_buffer_type(adev);
+        }
+        pthread_mutex_unlock(&adev->lock);
     }
 
-    str_parms_destroy(parms);
     return ret;
 }
 
-static char * adev_get_parameters(const struct audio_hw_device *dev __unused,
-                                  const char *keys __unused)
+static char * adev_get_parameters(const struct audio_hw_device *dev,
+                                  const char *keys)
 {
-    return strdup("");
+    struct audio_device *adev = (struct audio_device *)dev;
+    struct audio_parms query;
+    char reply[PARAMETERS_REPLY_SIZE] = "";
+
+    /* answered from cached state, without taking any lock */
+    audio_parms_parse(&query, keys);
+
+    if (audio_parms_has(&query, AUDIO_PARM_ORIENTATION))
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_ORIENTATION,
+                              orientation_names[adev->orientation]);
+    if (audio_parms_has(&query, AUDIO_PARM_SCREEN_STATE))
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SCREEN_STATE,
+                              adev->screen_off ? AUDIO_PARAMETER_VALUE_OFF :
+                                                 AUDIO_PARAMETER_VALUE_ON);
+
+    return strdup(reply);
 }
 
 static int adev_init_check(const struct audio_hw_device *dev __unused)
@@ -1141,7 +1637,10 @@ static int adev_set_mic_mute(struct audio_hw_device *dev, bool state)
 {
     struct audio_device *adev = (struct audio_device *)dev;
 
+    /* picked up by in_read(), which closes or reopens the capture PCM */
+    pthread_mutex_lock(&adev->lock);
     adev->mic_mute = state;
+    pthread_mutex_unlock(&adev->lock);
 
     return 0;
 }
@@ -1293,6 +1792,12 @@ static int adev_open(const hw_module_t* module, const char* name,
     adev->hw_device.dump = adev_dump;
 
     adev->ar = audio_route_init(MIXER_CARD, NULL);
+
+    /* optional: hints are skipped if there is no power HAL */
+    if (hw_get_module(POWER_HARDWARE_MODULE_ID,
+                      (const hw_module_t **)&adev->power))
+        adev->power = NULL;
+
     adev->orientation = ORIENTATION_UNDEFINED;
     adev->out_device = AUDIO_DEVICE_OUT_SPEAKER;
     adev->in_device = AUDIO_DEVICE_IN_BUILTIN_MIC & ~AUDIO_DEVICE_BIT_IN;
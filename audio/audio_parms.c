@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_parms.h"
+
+/* indexed by enum audio_parm_key */
+static const char * const audio_parm_names[AUDIO_PARM_KEY_COUNT] = {
+    [AUDIO_PARM_ROUTING]            = "routing",
+    [AUDIO_PARM_FORMAT]             = "format",
+    [AUDIO_PARM_CHANNELS]           = "channels",
+    [AUDIO_PARM_SAMPLING_RATE]      = "sampling_rate",
+    [AUDIO_PARM_SUP_FORMATS]        = "sup_formats",
+    [AUDIO_PARM_SUP_CHANNELS]       = "sup_channels",
+    [AUDIO_PARM_SUP_SAMPLING_RATES] = "sup_sampling_rates",
+    [AUDIO_PARM_ORIENTATION]        = "orientation",
+    [AUDIO_PARM_SCREEN_STATE]       = "screen_state",
+    [AUDIO_PARM_CHANNEL_MAP]        = "channel_map",
+};
+
+void audio_parms_parse(struct audio_parms *parms, const char *kvpairs)
+{
+    const char *p = kvpairs;
+
+    parms->present = 0;
+
+    while (p && *p) {
+        const char *key = p;
+        const char *value = NULL;
+        size_t key_len, value_len = 0;
+        int i;
+
+        while (*p && *p != '=' && *p != ';')
+            p++;
+        key_len = p - key;
+
+        if (*p == '=') {
+            value = ++p;
+            while (*p && *p != ';')
+                p++;
+            value_len = p - value;
+        }
+        if (*p == ';')
+            p++;
+
+        for (i = 0; i < AUDIO_PARM_KEY_COUNT; i++) {
+            if (strncmp(key, audio_parm_names[i], key_len) == 0 &&
+                    audio_parm_names[i][key_len] == '\0') {
+                parms->present |= 1U << i;
+                parms->value[i] = value ? value : key + key_len;
+                parms->len[i] = value_len;
+                break;
+            }
+        }
+    }
+}
+
+const char *audio_parms_key_name(enum audio_parm_key key)
+{
+    return audio_parm_names[key];
+}
+
+bool audio_parms_value_is(const struct audio_parms *parms,
+                          enum audio_parm_key key, const char *str)
+{
+    if (!audio_parms_has(parms, key))
+        return false;
+
+    return strlen(str) == parms->len[key] &&
+            strncmp(parms->value[key], str, parms->len[key]) == 0;
+}
+
+int audio_parms_get_uint(const struct audio_parms *parms,
+                         enum audio_parm_key key, unsigned int *val)
+{
+    const char *p, *end;
+    unsigned int base = 10;
+    unsigned int v = 0;
+
+    if (!audio_parms_has(parms, key))
+        return -ENOENT;
+
+    p = parms->value[key];
+    end = p + parms->len[key];
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    if (p == end)
+        return -EINVAL;
+
+    for (; p < end; p++) {
+        unsigned int digit;
+
+        if (*p >= '0' && *p <= '9')
+            digit = *p - '0';
+        else if (base == 16 && *p >= 'a' && *p <= 'f')
+            digit = *p - 'a' + 10;
+        else if (base == 16 && *p >= 'A' && *p <= 'F')
+            digit = *p - 'A' + 10;
+        else
+            return -EINVAL;
+
+        v = v * base + digit;
+    }
+
+    *val = v;
+    return 0;
+}
+
+int audio_parms_reply_str(char *buf, size_t size, enum audio_parm_key key,
+                          const char *value)
+{
+    size_t len = strlen(buf);
+    int ret;
+
+    ret = snprintf(buf + len, size - len, "%s%s=%s", len ? ";" : "",
+                   audio_parm_names[key], value);
+    if (ret < 0 || (size_t)ret >= size - len) {
+        buf[len] = '\0';
+        return -ENOSPC;
+    }
+
+    return 0;
+}
+
+int audio_parms_reply_uint(char *buf, size_t size, enum audio_parm_key key,
+                           unsigned int value)
+{
+    char str[12];
+
+    snprintf(str, sizeof(str), "%u", value);
+    return audio_parms_reply_str(buf, size, key, str);
+}
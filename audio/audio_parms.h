@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUDIO_PARMS_H
+#define AUDIO_PARMS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Allocation-free replacement for str_parms, used on the
+ * set_parameters()/get_parameters() paths of both audio HALs.
+ *
+ * audio_parms_parse() walks a "key1=value1;key2;..." string once and
+ * records, for each key we know about, a pointer to its value inside the
+ * caller's string. Nothing is copied, so the parsed table is only valid
+ * for as long as that string is. Unknown keys are ignored.
+ */
+
+enum audio_parm_key {
+    AUDIO_PARM_ROUTING,
+    AUDIO_PARM_FORMAT,
+    AUDIO_PARM_CHANNELS,
+    AUDIO_PARM_SAMPLING_RATE,
+    AUDIO_PARM_SUP_FORMATS,
+    AUDIO_PARM_SUP_CHANNELS,
+    AUDIO_PARM_SUP_SAMPLING_RATES,
+    AUDIO_PARM_ORIENTATION,
+    AUDIO_PARM_SCREEN_STATE,
+    AUDIO_PARM_CHANNEL_MAP,
+    AUDIO_PARM_KEY_COUNT,
+};
+
+struct audio_parms {
+    unsigned int present; /* bitmask of (1 << enum audio_parm_key) */
+    const char *value[AUDIO_PARM_KEY_COUNT];
+    size_t len[AUDIO_PARM_KEY_COUNT];
+};
+
+/* Fills parms from kvpairs; kvpairs may be NULL. */
+void audio_parms_parse(struct audio_parms *parms, const char *kvpairs);
+
+static inline bool audio_parms_has(const struct audio_parms *parms,
+                                   enum audio_parm_key key)
+{
+    return (parms->present & (1U << key)) != 0;
+}
+
+/* Returns the name of key as used in kvpairs strings. */
+const char *audio_parms_key_name(enum audio_parm_key key);
+
+/* True if key is present and its value is exactly str. */
+bool audio_parms_value_is(const struct audio_parms *parms,
+                          enum audio_parm_key key, const char *str);
+
+/*
+ * Parses the value of key as an unsigned integer (decimal, or hex with a
+ * 0x prefix). Returns 0 on success, -ENOENT if the key is absent and
+ * -EINVAL if the value is not a number.
+ */
+int audio_parms_get_uint(const struct audio_parms *parms,
+                         enum audio_parm_key key, unsigned int *val);
+
+/*
+ * Appends "key=value" to the reply being built in buf, separated from any
+ * previous entry by ';'. Returns 0, or -ENOSPC if buf is too small (buf
+ * is left unchanged in that case).
+ */
+int audio_parms_reply_str(char *buf, size_t size, enum audio_parm_key key,
+                          const char *value);
+int audio_parms_reply_uint(char *buf, size_t size, enum audio_parm_key key,
+                           unsigned int value);
+
+#endif /* AUDIO_PARMS_H */
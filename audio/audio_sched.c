@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_sched"
+/* #define LOG_NDEBUG 0 */
+
+#define _GNU_SOURCE /* sched_setaffinity(), gettid() */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "audio_sched.h"
+
+/* report the first missed deadline, then one in this many */
+#define MISSED_DEADLINE_LOG_INTERVAL 100
+
+struct audio_sched_policy {
+    const char *name;
+    int priority;
+    unsigned long cpu_mask;
+};
+
+/* indexed by enum audio_sched_class */
+static struct audio_sched_policy policies[AUDIO_SCHED_CLASS_COUNT] = {
+    [AUDIO_SCHED_FAST]        = { "fast",    3, 0x2 },
+    [AUDIO_SCHED_PRIMARY]     = { "primary", 2, 0x2 },
+    [AUDIO_SCHED_DEEP_BUFFER] = { "deep",    0, 0x0 },
+    [AUDIO_SCHED_HDMI]        = { "hdmi",    2, 0x2 },
+};
+
+static pthread_once_t policies_once = PTHREAD_ONCE_INIT;
+static int rt_denied;
+
+static void load_policies(void)
+{
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    int i;
+
+    for (i = 0; i < AUDIO_SCHED_CLASS_COUNT; i++) {
+        char *end;
+
+        snprintf(key, sizeof(key), "audio.sched.%s", policies[i].name);
+        if (property_get(key, value, NULL) <= 0)
+            continue;
+
+        policies[i].priority = strtol(value, &end, 0);
+        if (*end == ',')
+            policies[i].cpu_mask = strtoul(end + 1, NULL, 0);
+
+        ALOGV("%s: priority %d, cpu mask 0x%lx", key,
+              policies[i].priority, policies[i].cpu_mask);
+    }
+}
+
+static void policy_cpu_set(const struct audio_sched_policy *policy, cpu_set_t *set)
+{
+    unsigned int cpu;
+
+    CPU_ZERO(set);
+    for (cpu = 0; cpu < sizeof(policy->cpu_mask) * 8; cpu++)
+        if (policy->cpu_mask & (1UL << cpu))
+            CPU_SET(cpu, set);
+}
+
+/* Returns whether tid has lost the affinity its class policy gave it */
+static int affinity_lost(enum audio_sched_class cls, pid_t tid)
+{
+    const struct audio_sched_policy *policy = &policies[cls];
+    cpu_set_t want, set;
+
+    if (!policy->cpu_mask)
+        return 0;
+
+    policy_cpu_set(policy, &want);
+    if (sched_getaffinity(tid, sizeof(set), &set))
+        return 0;
+
+    return !CPU_EQUAL(&want, &set);
+}
+
+void audio_sched_init(struct audio_sched *sched, enum audio_sched_class cls)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->cls = cls;
+}
+
+int audio_sched_apply(enum audio_sched_class cls, pid_t tid)
+{
+    const struct audio_sched_policy *policy;
+    int ret = 0;
+
+    pthread_once(&policies_once, load_policies);
+    policy = &policies[cls];
+
+    /* without CAP_SYS_NICE, retrying would only fail again */
+    if (policy->priority > 0 && !rt_denied) {
+        struct sched_param param = { .sched_priority = policy->priority };
+
+        if (sched_setscheduler(tid, SCHED_FIFO, &param)) {
+            ret = -errno;
+            /* mediaserver usually lacks CAP_SYS_NICE; only say so once */
+            if (errno == EPERM) {
+                ALOGW("cannot set SCHED_FIFO %d for %s thread %d: %s",
+                      policy->priority, policy->name, tid, strerror(errno));
+                rt_denied = 1;
+                ret = 0;
+            }
+        }
+    }
+
+    if (policy->cpu_mask) {
+        cpu_set_t set;
+
+        policy_cpu_set(policy, &set);
+        if (sched_setaffinity(tid, sizeof(set), &set)) {
+            /* EINVAL: none of the CPUs is online, e.g. CPU1 hotplugged out */
+            ALOGW_IF(errno != EINVAL, "cannot set cpu mask 0x%lx for %s thread %d: %s",
+                     policy->cpu_mask, policy->name, tid, strerror(errno));
+            if (!ret)
+                ret = -errno;
+        }
+    }
+
+    return ret;
+}
+
+static void schedule_check(struct audio_sched *sched, const struct timespec *now)
+{
+    sched->check_at = *now;
+    sched->check_at.tv_sec += AUDIO_SCHED_CHECK_MS / 1000;
+    sched->check_at.tv_nsec += (AUDIO_SCHED_CHECK_MS % 1000) * 1000000;
+    if (sched->check_at.tv_nsec >= 1000000000) {
+        sched->check_at.tv_sec++;
+        sched->check_at.tv_nsec -= 1000000000;
+    }
+}
+
+void audio_sched_apply_current(struct audio_sched *sched)
+{
+    pid_t tid = gettid();
+    struct timespec now;
+
+    if (tid == sched->tid) {
+        /* the policy was applied, so policies[] is loaded */
+        if (!sched->retry && !policies[sched->cls].cpu_mask)
+            return;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec < sched->check_at.tv_sec ||
+                (now.tv_sec == sched->check_at.tv_sec &&
+                 now.tv_nsec < sched->check_at.tv_nsec))
+            return;
+
+        if (!sched->retry && !affinity_lost(sched->cls, tid)) {
+            schedule_check(sched, &now);
+            return;
+        }
+        ALOGV_IF(!sched->retry, "%s thread %d lost its cpu mask, reapplying",
+                 policies[sched->cls].name, tid);
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+
+    sched->tid = tid;
+    sched->retry = audio_sched_apply(sched->cls, tid) != 0;
+    schedule_check(sched, &now);
+}
+
+void audio_sched_check_deadline(struct audio_sched *sched, uint32_t deadline_us)
+{
+    struct timespec now;
+    int64_t elapsed_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sched->writes++;
+
+    if (sched->last_write.tv_sec || sched->last_write.tv_nsec) {
+        elapsed_us = (now.tv_sec - sched->last_write.tv_sec) * 1000000LL +
+                (now.tv_nsec - sched->last_write.tv_nsec) / 1000;
+
+        if (elapsed_us > deadline_us) {
+            if ((sched->missed++ % MISSED_DEADLINE_LOG_INTERVAL) == 0)
+                ALOGW("%s write %lld us after the previous one, deadline %u us "
+                      "(%u of %u writes late)", policies[sched->cls].name,
+                      (long long)elapsed_us, deadline_us,
+                      sched->missed, sched->writes);
+        }
+    }
+
+    sched->last_write = now;
+}
+
+void audio_sched_reset(struct audio_sched *sched)
+{
+    sched->last_write.tv_sec = 0;
+    sched->last_write.tv_nsec = 0;
+}
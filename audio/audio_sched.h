@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUDIO_SCHED_H
+#define AUDIO_SCHED_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define AUDIO_SCHED_CHECK_MS 1000
+
+/*
+ * Scheduling policy for audio threads, per output type.
+ *
+ * Each class has a SCHED_FIFO priority (0 leaves the scheduling policy
+ * alone) and a CPU affinity mask (0 leaves the affinity alone). The
+ * defaults below can be overridden with the property
+ * "audio.sched.<class>" set to "<priority>[,<cpu mask>]", e.g.
+ * "audio.sched.primary=2,0x2". Properties are read once per process.
+ *
+ * On OMAP4, CPU0 services the touch and GPU interrupts, so the default
+ * is to keep latency-sensitive audio on CPU1.
+ */
+
+enum audio_sched_class {
+    AUDIO_SCHED_FAST,
+    AUDIO_SCHED_PRIMARY,
+    AUDIO_SCHED_DEEP_BUFFER,
+    AUDIO_SCHED_HDMI,
+    AUDIO_SCHED_CLASS_COUNT,
+};
+
+struct audio_sched {
+    enum audio_sched_class cls;
+    pid_t tid;                  /* thread the policy was last applied to */
+    int retry;                  /* applying it failed, try again at check_at */
+    struct timespec check_at;   /* next retry or affinity check */
+    struct timespec last_write; /* zero until the first write */
+    unsigned int writes;
+    unsigned int missed;        /* writes that arrived after the deadline */
+};
+
+void audio_sched_init(struct audio_sched *sched, enum audio_sched_class cls);
+
+/* Applies the class policy to thread tid. Returns 0 or -errno. */
+int audio_sched_apply(enum audio_sched_class cls, pid_t tid);
+
+/*
+ * Applies the policy to the calling thread unless it was already applied
+ * to it. A policy that failed to apply is retried every
+ * AUDIO_SCHED_CHECK_MS, and the CPU affinity is checked as often: the
+ * kernel drops it when the CPUs in the mask are hotplugged out, and the
+ * power HAL takes CPU1 offline while the screen is off. Cheap enough to
+ * call on every write.
+ */
+void audio_sched_apply_current(struct audio_sched *sched);
+
+/*
+ * Records a write and checks that it came no later than deadline_us after
+ * the previous one, i.e. before the data already queued ran out.
+ */
+void audio_sched_check_deadline(struct audio_sched *sched, uint32_t deadline_us);
+
+/* Forget the previous write, e.g. when the stream enters standby. */
+void audio_sched_reset(struct audio_sched *sched);
+
+#endif /* AUDIO_SCHED_H */
@@ -1,5 +1,6 @@
 #define PCM_CARD                0
 #define PCM_CARD_HDMI           1
+#define PCM_CARD_HDMI_NAME      "OMAP4HDMI"
 
 #define PCM_CARD_DEFAULT        PCM_CARD
 
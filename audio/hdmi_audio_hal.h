@@ -17,9 +17,66 @@
 #ifndef TI_HDMI_AUDIO_HAL
 #define TI_HDMI_AUDIO_HAL
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* TODO: Figure this out dynamically, but ATM this is enforced
+ * in the kernel.
+ */
+#define HDMI_MAX_EDID 512
+
+#define HDMI_EDID_PATH "/sys/devices/omapdss/display1/edid"
+
+/* CEA-861-D Table 37: audio format codes */
+#define CEA_FORMAT_LPCM     1
+#define CEA_FORMAT_AC3      2
+#define CEA_FORMAT_MPEG1    3
+#define CEA_FORMAT_MP3      4
+#define CEA_FORMAT_MPEG2    5
+#define CEA_FORMAT_AAC      6
+#define CEA_FORMAT_DTS      7
+#define CEA_FORMAT_ATRAC    8
+#define CEA_FORMAT_ONE_BIT  9
+#define CEA_FORMAT_EAC3     10
+#define CEA_FORMAT_DTS_HD   11
+#define CEA_FORMAT_MAT      12
+#define CEA_FORMAT_DST      13
+#define CEA_FORMAT_WMA_PRO  14
+
+/* Short audio descriptor sample rate bits */
+#define CEA_RATE_32000  (1 << 0)
+#define CEA_RATE_44100  (1 << 1)
+#define CEA_RATE_48000  (1 << 2)
+#define CEA_RATE_88200  (1 << 3)
+#define CEA_RATE_96000  (1 << 4)
+#define CEA_RATE_176400 (1 << 5)
+#define CEA_RATE_192000 (1 << 6)
+#define CEA_RATE_COUNT  7
+
+/* Short audio descriptor LPCM sample size bits */
+#define CEA_LPCM_16BIT  (1 << 0)
+#define CEA_LPCM_20BIT  (1 << 1)
+#define CEA_LPCM_24BIT  (1 << 2)
+
+/* Basic audio, implied by any HDMI sink with audio: 2ch LPCM */
+#define CEA_BASIC_AUDIO_RATES (CEA_RATE_32000 | CEA_RATE_44100 | CEA_RATE_48000)
+
+/* A CEA data block holds at most 31 bytes, i.e. 10 descriptors */
+#define HDMI_MAX_SADS 10
+
+typedef struct _hdmi_sad {
+    int format;         /* CEA_FORMAT_* */
+    int max_channels;
+    int rates;          /* CEA_RATE_* bitmap */
+    int sample_sizes;   /* LPCM only: CEA_LPCM_* bitmap */
+    int max_bitrate;    /* AC-3 to ATRAC only: kbit/s */
+} hdmi_sad_t;
+
 typedef struct _hdmi_audio_caps {
     int has_audio;
     int speaker_alloc;
+    int num_sads;
+    hdmi_sad_t sads[HDMI_MAX_SADS];
 } hdmi_audio_caps_t;
 
 /* Speaker allocation bits */
@@ -34,4 +91,29 @@ typedef struct _hdmi_audio_caps {
 /* Defined in file hdmi_audio_utils.c */
 int hdmi_query_audio_caps(const char* edid_path, hdmi_audio_caps_t *caps);
 
+/*
+ * Defined in file hdmi_caps_cache.c. Returns the caps of the sink on
+ * HDMI_EDID_PATH, or -errno. The EDID is parsed once per process and
+ * cached until an HDMI hotplug uevent. If uevents cannot be monitored,
+ * it is re-read on every call but only re-parsed when it changes.
+ */
+int hdmi_get_audio_caps(hdmi_audio_caps_t *caps);
+
+/* Reads up to size bytes of EDID; returns the length read or -errno */
+int hdmi_read_edid(const char* edid_path, unsigned char *edid, size_t size);
+/* edid must be HDMI_MAX_EDID bytes, zero-padded past what was read */
+void hdmi_parse_audio_caps(const unsigned char *edid, hdmi_audio_caps_t *caps);
+/* Cheap content hash, to tell whether a re-read EDID changed */
+uint32_t hdmi_edid_hash(const unsigned char *edid, size_t len);
+
+/* Returns the descriptor for a CEA_FORMAT_*, or NULL if not supported */
+const hdmi_sad_t *hdmi_caps_find_format(const hdmi_audio_caps_t *caps, int format);
+/* Returns the sample rate in Hz of CEA_RATE_* bit number n */
+unsigned int hdmi_cea_rate(int n);
+/* Returns the CEA_RATE_* bitmap of LPCM rates the sink takes with channels */
+int hdmi_caps_lpcm_rates(const hdmi_audio_caps_t *caps, int channels);
+/* Returns the LPCM rate of the sink best suited to play content at rate */
+unsigned int hdmi_caps_select_rate(const hdmi_audio_caps_t *caps, unsigned int rate,
+                                   int channels);
+
 #endif /* TI_HDMI_AUDIO_HAL */
@@ -34,9 +34,10 @@
 #include <sys/time.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
-#include <cutils/str_parms.h>
 #include <cutils/properties.h>
 
 #include <hardware/hardware.h>
@@ -47,7 +48,18 @@
 
 #include <OMX_Audio.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "alsa_card.h"
 #include "hdmi_audio_hal.h"
+#include "hdmi_iec61937.h"
+#include "audio_parms.h"
+#include "audio_sched.h"
+
+/* board card layout, shared with the primary HAL */
+#include <audio_hw_config.h>
 
 #define HDMI_AUDIO_CHANNEL_OUT_SURROUND	(AUDIO_CHANNEL_OUT_FRONT_LEFT | \
 					 AUDIO_CHANNEL_OUT_FRONT_RIGHT | \
@@ -56,38 +68,82 @@
 
 #define UNUSED(x) (void)(x)
 
-/* XXX TODO: Dynamically detect the HDMI card
- * E.g. if a USB device is plugged in at boot time,
- * it sometimes takes the card #1 slot and puts us
- * on card #2.
- */
 #define HDMI_PCM_DEV 0
 #define HDMI_SAMPLING_RATE 44100
 #define HDMI_PERIOD_SIZE 1920
 #define HDMI_PERIOD_COUNT 4
 #define HDMI_MAX_CHANNELS 8
 
-#define HDMI_EDID_PATH "/sys/devices/omapdss/display1/edid"
+/* poll interval while waiting for a write to leave the PCM alone */
+#define HDMI_WAIT_US 1000
+/* report the first underrun, then one in this many */
+#define HDMI_UNDERRUN_LOG_INTERVAL 100
 
 typedef audio_hw_device_t hdmi_device_t;
 
+/* A channel map, compiled for the write path */
+struct hdmi_remap {
+    bool CEAMap; /* close enough to CEA order to play unmapped */
+    /* remap[n][y] is the input channel that feeds output channel y of an
+     * n-channel stream, or -1 for silence. */
+    int8_t remap[HDMI_MAX_CHANNELS + 1][HDMI_MAX_CHANNELS];
+};
+
 struct hdmi_device_t {
+    audio_hw_device_t device; /* must be first: cast from hdmi_device_t */
+
+    /*
+     * The channel_map parameter is compiled into the spare one of
+     * remaps[] and published by flipping remap_idx, RCU style: the write
+     * path picks up the current table once per write without locking,
+     * and the spare table is only rewritten once every write that could
+     * still be using it has finished (see hdmi_publish_channel_map()).
+     */
+    pthread_mutex_t remap_lock; /* map[] and channel map updates */
     int map[HDMI_MAX_CHANNELS];
-    bool CEAMap;
+    struct hdmi_remap remaps[2];
+    volatile int32_t remap_idx;
+
+    /* open output streams, for the control paths only */
+    pthread_mutex_t streams_lock;
+    struct _hdmi_out *streams;
 };
 
 int cea_channel_map[HDMI_MAX_CHANNELS] = {OMX_AUDIO_ChannelLF,OMX_AUDIO_ChannelRF,OMX_AUDIO_ChannelLFE,
         OMX_AUDIO_ChannelCF,OMX_AUDIO_ChannelLS,OMX_AUDIO_ChannelRS,
         OMX_AUDIO_ChannelLR,OMX_AUDIO_ChannelRR};  /*Using OMX_AUDIO_CHANNELTYPE mapping*/
 
+/*
+ * Output state. Only the writer opens the PCM (STANDBY -> UP). A standby
+ * moves UP -> CLOSING, waits until no write is in progress and closes
+ * the PCM (CLOSING -> STANDBY). A write that finds the stream CLOSING
+ * waits for that to finish. The write path takes no locks other than the
+ * short pos_lock for the frame count.
+ */
+enum hdmi_out_state {
+    HDMI_OUT_STANDBY,
+    HDMI_OUT_UP,
+    HDMI_OUT_CLOSING,
+};
+
 typedef struct _hdmi_out {
     audio_stream_out_t stream_out;
     hdmi_device_t *dev;
+    struct _hdmi_out *next; /* in hdmi_device_t.streams */
+    volatile int32_t state; /* enum hdmi_out_state */
+    volatile int32_t write_seq; /* odd while inside hdmi_out_write() */
+    pthread_mutex_t pos_lock; /* pcm and written, for position queries */
     struct pcm_config config;
     struct pcm *pcm;
     audio_config_t android_config;
-    int up;
-    void *buffcpy;
+    void *buffcpy; /* one period, staged (and remapped) for the PCM */
+    size_t staged; /* bytes in buffcpy */
+    struct audio_sched sched;
+    /* compressed passthrough: writes are packed into IEC 61937 bursts */
+    bool passthrough;
+    struct iec61937 iec;
+    uint64_t written; /* PCM frames, not cleared on standby */
+    unsigned int underruns;
 } hdmi_out_t;
 
 #define S16_SIZE sizeof(int16_t)
@@ -106,9 +162,9 @@ typedef struct _hdmi_out {
 uint32_t hdmi_out_get_sample_rate(const struct audio_stream *stream)
 {
     hdmi_out_t *out = (hdmi_out_t*)stream;
-    struct pcm_config *config = &out->config;
-    TRACEM("stream=%p returning %d", stream, config->rate);
-    return config->rate;
+    /* the PCM runs at the link rate in passthrough, e.g. 4x for E-AC-3 */
+    TRACEM("stream=%p returning %d", stream, out->android_config.sample_rate);
+    return out->android_config.sample_rate;
 }
 
 /* DEPRECATED API */
@@ -153,21 +209,83 @@ int hdmi_out_set_format(struct audio_stream *stream, audio_format_t format)
     return -EINVAL;
 }
 
+/* Returns once the write in progress on out, if any, has finished */
+static void hdmi_out_wait_write(hdmi_out_t *out)
+{
+    int32_t seq = android_atomic_acquire_load(&out->write_seq);
+
+    while ((seq & 1) && android_atomic_acquire_load(&out->write_seq) == seq)
+        usleep(HDMI_WAIT_US);
+}
+
+static int hdmi_out_find_card(void);
+static void hdmi_out_set_channel_status(hdmi_out_t *out, int card, bool non_audio);
+static void hdmi_out_flush_staged(hdmi_out_t *out);
+
+/*
+ * Closes the PCM of a stream in a state the writer cannot open it from.
+ * Must be called by the writer, or once no write is in progress.
+ */
+static void hdmi_out_close_pcm(hdmi_out_t *out)
+{
+    pthread_mutex_lock(&out->pos_lock);
+    pcm_close(out->pcm);
+    out->pcm = 0;
+    pthread_mutex_unlock(&out->pos_lock);
+
+    out->staged = 0;
+    audio_sched_reset(&out->sched);
+    if (out->passthrough) {
+        iec61937_reset(&out->iec);
+        /* the primary HAL's HDMI path plays PCM without setting it */
+        hdmi_out_set_channel_status(out, hdmi_out_find_card(), false);
+    }
+}
+
+/* Returns once no standby is in progress */
+static void hdmi_out_wait_idle(hdmi_out_t *out)
+{
+    while (android_atomic_acquire_load(&out->state) == HDMI_OUT_CLOSING)
+        usleep(HDMI_WAIT_US);
+}
+
 int hdmi_out_standby(struct audio_stream *stream)
 {
     hdmi_out_t *out = (hdmi_out_t*)stream;
 
     TRACEM("stream=%p", stream);
 
-    if (out->up && out->pcm) {
-        out->up = 0;
-        pcm_close(out->pcm);
-        out->pcm = 0;
+    if (android_atomic_acquire_cas(HDMI_OUT_UP, HDMI_OUT_CLOSING, &out->state) == 0) {
+        hdmi_out_wait_write(out);
+        hdmi_out_flush_staged(out);
+        hdmi_out_close_pcm(out);
+        android_atomic_release_store(HDMI_OUT_STANDBY, &out->state);
     }
 
+    /* a failed write may be closing the PCM itself */
+    hdmi_out_wait_idle(out);
+
     return 0;
 }
 
+/*
+ * Sets up a new PCM stream at the sink rate that best suits content at
+ * rate, given the stream's channel count. Called at open only: the rate
+ * reported to the framework then never changes under it.
+ */
+static void hdmi_out_select_rate(hdmi_out_t *out, unsigned int rate)
+{
+    hdmi_audio_caps_t caps;
+    unsigned int sink_rate = rate;
+
+    if (hdmi_get_audio_caps(&caps) == 0)
+        sink_rate = hdmi_caps_select_rate(&caps, rate, out->config.channels);
+    ALOGV_IF(sink_rate != rate, "HDMI sink takes %u Hz content at %u Hz", rate, sink_rate);
+
+    out->config.rate = sink_rate;
+    out->android_config.sample_rate = sink_rate;
+}
+
 int hdmi_out_dump(const struct audio_stream *stream, int fd)
 {
     TRACE();
@@ -189,7 +307,19 @@ int hdmi_out_set_device(struct audio_stream *stream, audio_devices_t device)
 
 int hdmi_out_set_parameters(struct audio_stream *stream, const char *kv_pairs)
 {
+    hdmi_out_t *out = (hdmi_out_t*)stream;
+    struct audio_parms params;
+    unsigned int rate;
+
     TRACEM("stream=%p kv_pairs='%s'", stream, kv_pairs);
+
+    audio_parms_parse(&params, kv_pairs);
+
+    /* the rate is picked at open; the framework must reopen to change it */
+    if (audio_parms_get_uint(&params, AUDIO_PARM_SAMPLING_RATE, &rate) == 0 &&
+        rate != out->android_config.sample_rate)
+        return -ENOSYS;
+
     return 0;
 }
 
@@ -202,27 +332,30 @@ int hdmi_out_set_parameters(struct audio_stream *stream, const char *kv_pairs)
 char * hdmi_out_get_parameters(const struct audio_stream *stream,
 			 const char *keys)
 {
-    struct str_parms *query = str_parms_create_str(keys);
-    char *str;
+    struct audio_parms query;
     char value[256];
-    struct str_parms *reply = str_parms_create();
-    int status;
+    char reply[256] = "";
     hdmi_audio_caps_t caps;
 
     TRACEM("stream=%p keys='%s'", stream, keys);
 
-    if (hdmi_query_audio_caps(HDMI_EDID_PATH, &caps)) {
-        ALOGE("Unable to get the HDMI audio capabilities");
-        str = calloc(1, 1);
-        goto end;
+    audio_parms_parse(&query, keys);
+
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_CHANNELS) ||
+        audio_parms_has(&query, AUDIO_PARM_SUP_SAMPLING_RATES) ||
+        audio_parms_has(&query, AUDIO_PARM_SUP_FORMATS)) {
+        if (hdmi_get_audio_caps(&caps)) {
+            ALOGE("Unable to get the HDMI audio capabilities");
+            return calloc(1, 1);
+        }
     }
 
-    status = str_parms_get_str(query, AUDIO_PARAMETER_STREAM_SUP_CHANNELS,
-                                value, sizeof(value));
-    if (status >= 0) {
-        unsigned sa = caps.speaker_alloc;
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_CHANNELS)) {
+        unsigned sa;
         bool first = true;
 
+        sa = caps.speaker_alloc;
+
         /* STEREO is intentionally skipped.  This code is only
          * executed for the 'DIRECT' interface, and we don't
          * want stereo on a DIRECT thread.
@@ -256,18 +389,43 @@ char * hdmi_out_get_parameters(const struct audio_stream *stream,
             first = false;
             strcat(value, "AUDIO_CHANNEL_OUT_7POINT1");
         }
-        str_parms_add_str(reply, AUDIO_PARAMETER_STREAM_SUP_CHANNELS, value);
-        str = strdup(str_parms_to_str(reply));
-    } else {
-        str = strdup(keys);
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_CHANNELS, value);
+    }
+
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_SAMPLING_RATES)) {
+        /* Every sink with audio must take basic audio, even if its
+         * SADs fail to list it.
+         */
+        int rates = hdmi_caps_lpcm_rates(&caps, 0);
+        char *p = value;
+        int n;
+
+        value[0] = '\0';
+        for (n = 0 ; n < CEA_RATE_COUNT ; n++) {
+            if (rates & (1 << n)) {
+                p += sprintf(p, "%s%u", (p == value) ? "" : "|", hdmi_cea_rate(n));
+            }
+        }
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_SAMPLING_RATES, value);
     }
 
-    ALOGV("%s() reply: '%s'", __func__, str);
+    if (audio_parms_has(&query, AUDIO_PARM_SUP_FORMATS)) {
+        /* The PCM path renders 16 bit only; every LPCM sink takes it */
+        strcpy(value, "AUDIO_FORMAT_PCM_16_BIT");
+        if (hdmi_caps_find_format(&caps, CEA_FORMAT_AC3))
+            strcat(value, "|AUDIO_FORMAT_AC3");
+        if (hdmi_caps_find_format(&caps, CEA_FORMAT_EAC3))
+            strcat(value, "|AUDIO_FORMAT_E_AC3");
+#ifdef HAVE_AUDIO_FORMAT_DTS
+        if (hdmi_caps_find_format(&caps, CEA_FORMAT_DTS))
+            strcat(value, "|AUDIO_FORMAT_DTS");
+#endif
+        audio_parms_reply_str(reply, sizeof(reply), AUDIO_PARM_SUP_FORMATS, value);
+    }
+
+    ALOGV("%s() reply: '%s'", __func__, reply);
 
-end:
-    str_parms_destroy(query);
-    str_parms_destroy(reply);
-    return str;
+    return strdup(reply);
 }
 int hdmi_out_add_audio_effect(const struct audio_stream *stream,
 			effect_handle_t effect)
@@ -302,68 +460,294 @@ int hdmi_out_set_volume(struct audio_stream_out *stream, float left, float right
 
 static int hdmi_out_find_card(void)
 {
-    /* XXX TODO: Dynamically detect HDMI card
-     * If another audio device is present at boot time (e.g.
-     * USB Audio device) then it might take the card #1
-     * position, putting HDMI on card #2.
-     */
-    return 1;
+    /* e.g. a USB audio device present at boot can take slot #1 */
+#ifdef PCM_CARD_HDMI_NAME
+    return alsa_card_find(PCM_CARD_HDMI_NAME, PCM_CARD_HDMI);
+#else
+    return PCM_CARD_HDMI;
+#endif
+}
+
+/* IEC 60958-3 channel status sampling frequency codes, byte 3 */
+static unsigned char hdmi_iec958_rate_code(unsigned int rate)
+{
+    switch (rate) {
+    case 44100:  return 0x00;
+    case 48000:  return 0x02;
+    case 32000:  return 0x03;
+    case 88200:  return 0x08;
+    case 96000:  return 0x0a;
+    case 176400: return 0x0c;
+    case 192000: return 0x0e;
+    default:     return 0x01; /* not indicated */
+    }
+}
+
+/*
+ * Sets the IEC 60958 channel status of the card. Passthrough streams are
+ * flagged as non-audio, so the sink does not play the bursts as PCM
+ * before it spots the preambles; the flag stays on the card until
+ * cleared, so PCM streams clear it. Not every HDMI codec driver exposes
+ * the control; the bursts are still detected by their preambles without
+ * it.
+ */
+static void hdmi_out_set_channel_status(hdmi_out_t *out, int card, bool non_audio)
+{
+    struct mixer *mixer;
+    struct mixer_ctl *ctl;
+    unsigned char status[24];
+
+    mixer = mixer_open(card);
+    if (!mixer) {
+        ALOGW("Unable to open the HDMI mixer, channel status not set");
+        return;
+    }
+
+    ctl = mixer_get_ctl_by_name(mixer, "IEC958 Playback Default");
+    if (ctl) {
+        memset(status, 0, sizeof(status));
+        status[0] = non_audio ? 0x02 : 0x00; /* consumer, (non-)audio */
+        status[3] = hdmi_iec958_rate_code(out->config.rate);
+        if (mixer_ctl_set_array(ctl, status, sizeof(status)))
+            ALOGW("Unable to set the IEC958 channel status");
+    } else {
+        ALOGV("No IEC958 channel status control on card %d", card);
+    }
+
+    mixer_close(mixer);
 }
 
+/* Called from hdmi_out_write() on a STANDBY stream */
 static int hdmi_out_open_pcm(hdmi_out_t *out)
 {
     int card = hdmi_out_find_card();
     int dev = HDMI_PCM_DEV;
+    struct pcm *pcm;
     int ret;
 
     TRACEM("out=%p", out);
 
-    /* out->up must be 0 (down) */
-    if (out->up) {
-        ALOGE("Trying to open a PCM that's already up. "
-             "This will probably deadlock... so aborting");
-        return 0;
-    }
-
-    out->pcm = pcm_open(card, dev, PCM_OUT, &out->config);
+    pcm = pcm_open(card, dev, PCM_OUT | PCM_MMAP, &out->config);
 
-    if(out->pcm && pcm_is_ready(out->pcm)) {
-        out->up = 1;
+    if(pcm && pcm_is_ready(pcm)) {
+        pthread_mutex_lock(&out->pos_lock);
+        out->pcm = pcm;
+        pthread_mutex_unlock(&out->pos_lock);
         ret = 0;
+        hdmi_out_set_channel_status(out, card, out->passthrough);
     } else {
         ALOGE("cannot open HDMI pcm card %d dev %d error: %s",
-              card, dev, pcm_get_error(out->pcm));
-        pcm_close(out->pcm);
-        out->pcm = 0;
-        out->up = 0;
+              card, dev, pcm_get_error(pcm));
+        pcm_close(pcm);
         ret = 1;
     }
 
     return ret;
 }
 
-void channel_remap(struct audio_stream_out *stream, const void *buffer,
-                    size_t bytes)
+/* Compiles adev->map[] into table. Must be called with adev->remap_lock held. */
+static void compile_channel_remap(struct hdmi_device_t *adev, struct hdmi_remap *table)
+{
+    int n, x, y, numMatch = 0;
+
+    for (x = 0; x < HDMI_MAX_CHANNELS; x++) {
+        if (adev->map[x] == cea_channel_map[x])
+            numMatch += 1;
+    }
+    table->CEAMap = (numMatch >= 5);
+
+    for (n = 1; n <= HDMI_MAX_CHANNELS; n++) {
+        for (y = 0; y < n; y++) {
+            table->remap[n][y] = -1;
+            for (x = 0; x < n; x++) {
+                if (cea_channel_map[y] == adev->map[x]) {
+                    table->remap[n][y] = x;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Makes adev->map[] the channel map of all subsequent writes. May wait for
+ * writes in progress. Must be called with adev->remap_lock held.
+ */
+static void hdmi_publish_channel_map(struct hdmi_device_t *adev)
+{
+    int32_t spare = !adev->remap_idx;
+    hdmi_out_t *out;
+
+    /* writes that began before the last flip may still use the spare table */
+    pthread_mutex_lock(&adev->streams_lock);
+    for (out = adev->streams; out; out = out->next)
+        hdmi_out_wait_write(out);
+    pthread_mutex_unlock(&adev->streams_lock);
+
+    compile_channel_remap(adev, &adev->remaps[spare]);
+    android_atomic_release_store(spare, &adev->remap_idx);
+}
+
+void channel_remap(struct audio_stream_out *stream, const struct hdmi_remap *table,
+                    const void *buffer, void *dest, size_t bytes)
 {
         hdmi_out_t *out = (hdmi_out_t*)stream;
-        struct hdmi_device_t *adev = (struct hdmi_device_t *)out->dev;
-        int x, y, frames;
-        int16_t *buf = (int16_t *)buffer;
-        int16_t *tmp_buf = (int16_t *)out->buffcpy;
+        const int channels = out->config.channels;
+        const int8_t *remap = table->remap[channels];
+        const int16_t *buf = (const int16_t *)buffer;
+        int16_t *tmp_buf = (int16_t *)dest;
+        int y, frames;
 
         frames = (bytes/audio_stream_frame_size(&out->stream_out.common));
-        while (frames--){
-            for(y = 0; y < (int)out->config.channels; y++){
-                for(x = 0; x < (int)out->config.channels; x++){
-                    if (cea_channel_map[y] == adev->map[x]){
-                        tmp_buf[y] = buf[x];
-                        break;
+
+#if defined(__ARM_NEON__)
+        /*
+         * When a whole number of frames fits in 16 bytes (2, 4 or 8
+         * channels), shuffle them with two table lookups per vector.
+         * Out of range indices (0xff) produce silence.
+         */
+        if ((8 % channels) == 0) {
+            const int frames_per_vec = 8 / channels;
+            uint8_t idx[16];
+            uint8x8_t idx_lo, idx_hi;
+            int f;
+
+            for (f = 0; f < frames_per_vec; f++) {
+                for (y = 0; y < channels; y++) {
+                    uint8_t *i = &idx[(f * channels + y) * 2];
+                    if (remap[y] < 0) {
+                        i[0] = i[1] = 0xff;
+                    } else {
+                        i[0] = (f * channels + remap[y]) * 2;
+                        i[1] = i[0] + 1;
                     }
                 }
             }
-            tmp_buf += (int)out->config.channels;
-            buf += (int)out->config.channels;
+            idx_lo = vld1_u8(idx);
+            idx_hi = vld1_u8(idx + 8);
+
+            for (; frames >= frames_per_vec; frames -= frames_per_vec) {
+                uint8x8x2_t v;
+
+                v.val[0] = vld1_u8((const uint8_t *)buf);
+                v.val[1] = vld1_u8((const uint8_t *)buf + 8);
+                vst1_u8((uint8_t *)tmp_buf, vtbl2_u8(v, idx_lo));
+                vst1_u8((uint8_t *)tmp_buf + 8, vtbl2_u8(v, idx_hi));
+                buf += 8;
+                tmp_buf += 8;
+            }
+        }
+#endif
+
+        while (frames--){
+            for(y = 0; y < channels; y++)
+                tmp_buf[y] = (remap[y] < 0) ? 0 : buf[remap[y]];
+            tmp_buf += channels;
+            buf += channels;
+        }
+}
+
+/*
+ * Writes to the mmap ring, sleeping beforehand until the ring has room
+ * rather than blocking in the driver. An underrun restarts the stream
+ * in place: closing the PCM makes many sinks drop the link and take a
+ * second to re-lock. Called from hdmi_out_write().
+ */
+static int hdmi_out_pcm_write(hdmi_out_t *out, const void *data, size_t bytes)
+{
+    unsigned int frames = bytes / (out->config.channels * S16_SIZE);
+    unsigned int avail;
+    struct timespec ts;
+    int ret;
+
+    if (pcm_get_htimestamp(out->pcm, &avail, &ts) == 0 && avail < frames) {
+        usleep(((int64_t)(frames - avail) * 1000000) / out->config.rate);
+    }
+
+    ret = pcm_mmap_write(out->pcm, data, bytes);
+    if (ret == -EPIPE) {
+        ALOGW_IF((out->underruns++ % HDMI_UNDERRUN_LOG_INTERVAL) == 0,
+                 "HDMI underrun (%u), restarting", out->underruns);
+        /*
+         * The mmap path leaves tinyalsa's prepared flag set across an xrun,
+         * and pcm_prepare() is a no-op until pcm_stop() clears it.
+         */
+        pcm_stop(out->pcm);
+        ret = pcm_prepare(out->pcm);
+        if (!ret)
+            ret = pcm_mmap_write(out->pcm, data, bytes);
+    }
+    if (!ret) {
+        pthread_mutex_lock(&out->pos_lock);
+        out->written += frames;
+        pthread_mutex_unlock(&out->pos_lock);
+    }
+
+    return ret;
+}
+
+/*
+ * Writes PCM to the ring in whole periods only, whatever size the writes
+ * come in. Partial periods are collected in out->buffcpy, remapping on
+ * the way in so the data is touched once; whole periods that need no
+ * remap go straight to the ring. Called from hdmi_out_write().
+ */
+static int hdmi_out_write_periods(hdmi_out_t *out, const struct hdmi_remap *table,
+                                  const void *buffer, size_t bytes)
+{
+    const size_t period = out->config.period_size * out->config.channels * S16_SIZE;
+    const bool remap = out->config.channels > 2 && !table->CEAMap;
+    const char *src = (const char *)buffer;
+    size_t n;
+    int ret = 0;
+
+    while (bytes && !ret) {
+        if (!out->staged && !remap && bytes >= period) {
+            n = bytes - bytes % period;
+            ret = hdmi_out_pcm_write(out, src, n);
+        } else {
+            n = period - out->staged;
+            if (n > bytes)
+                n = bytes;
+            if (remap)
+                channel_remap(&out->stream_out, table, src,
+                              (char *)out->buffcpy + out->staged, n);
+            else
+                memcpy((char *)out->buffcpy + out->staged, src, n);
+            out->staged += n;
+            if (out->staged == period) {
+                ret = hdmi_out_pcm_write(out, out->buffcpy, period);
+                out->staged = 0;
+            }
         }
+        src += n;
+        bytes -= n;
+    }
+
+    return ret;
+}
+
+/*
+ * Writes the partial period left in out->buffcpy, if any, padded with
+ * silence to a whole period, so that standby does not cut the tail of
+ * the stream short. The padding is not counted as played. Must be called
+ * by the writer, or once no write is in progress.
+ */
+static void hdmi_out_flush_staged(hdmi_out_t *out)
+{
+    const size_t frame = out->config.channels * S16_SIZE;
+    const size_t period = out->config.period_size * frame;
+
+    if (!out->staged || !out->pcm)
+        return;
+
+    memset((char *)out->buffcpy + out->staged, 0, period - out->staged);
+    if (hdmi_out_pcm_write(out, out->buffcpy, period) == 0) {
+        pthread_mutex_lock(&out->pos_lock);
+        out->written -= (period - out->staged) / frame;
+        pthread_mutex_unlock(&out->pos_lock);
+    }
+    out->staged = 0;
 }
 
 ssize_t hdmi_out_write(struct audio_stream_out *stream, const void* buffer,
@@ -371,39 +755,129 @@ ssize_t hdmi_out_write(struct audio_stream_out *stream, const void* buffer,
 {
     hdmi_out_t *out = (hdmi_out_t*)stream;
     struct hdmi_device_t *adev = (struct hdmi_device_t *)out->dev;
+    const struct hdmi_remap *table;
+    int32_t state;
     ssize_t ret;
 
     TRACEM("stream=%p buffer=%p bytes=%d", stream, buffer, bytes);
 
-    if (!out->up) {
+    audio_sched_apply_current(&out->sched);
+
+    for (;;) {
+        android_atomic_inc(&out->write_seq);
+        state = android_atomic_acquire_load(&out->state);
+        if (state != HDMI_OUT_CLOSING)
+            break;
+        /* step out and let the standby close the PCM */
+        android_atomic_inc(&out->write_seq);
+        usleep(HDMI_WAIT_US);
+    }
+
+    if (state == HDMI_OUT_STANDBY) {
         if(hdmi_out_open_pcm(out)) {
+            android_atomic_inc(&out->write_seq);
             return -ENOSYS;
         }
+        android_atomic_release_store(HDMI_OUT_UP, &out->state);
     }
 
-    if (out->config.channels > 2 && !adev->CEAMap){
-        channel_remap(stream, buffer, bytes);
-        ret = pcm_write(out->pcm, out->buffcpy, bytes);
+    table = &adev->remaps[android_atomic_acquire_load(&adev->remap_idx)];
+
+    if (out->passthrough) {
+        const char *src = (const char *)buffer;
+        size_t left = bytes;
+        const void *burst;
+
+        ret = 0;
+        while (left && !ret) {
+            size_t n = iec61937_pack(&out->iec, src, left, &burst);
+
+            if (burst)
+                ret = hdmi_out_pcm_write(out, burst, out->iec.burst_size);
+            src += n;
+            left -= n;
+        }
     } else {
-       ret = pcm_write(out->pcm, buffer, bytes);
+        ret = hdmi_out_write_periods(out, table, buffer, bytes);
     }
     if (ret) {
         ALOGE("Error writing to HDMI pcm: %s", pcm_get_error(out->pcm));
         ret = (ret < 0) ? ret : -ret;
-        hdmi_out_standby((struct audio_stream*)stream);
+        if (android_atomic_acquire_cas(HDMI_OUT_UP, HDMI_OUT_CLOSING, &out->state) == 0) {
+            hdmi_out_close_pcm(out);
+            android_atomic_release_store(HDMI_OUT_STANDBY, &out->state);
+        }
     } else {
         ret = bytes;
+        audio_sched_check_deadline(&out->sched,
+                (1000000LL * out->config.period_size * out->config.period_count) /
+                out->config.rate);
     }
 
+    android_atomic_inc(&out->write_seq);
+
     return ret;
 }
 
+/*
+ * Returns the number of frames played so far, in stream frames (these
+ * differ from PCM frames for E-AC-3 passthrough), and when the count was
+ * sampled. Must be called with out->pos_lock held.
+ */
+static int hdmi_out_get_played(hdmi_out_t *out, uint64_t *frames,
+                               struct timespec *timestamp)
+{
+    unsigned int avail, size;
+    uint64_t queued;
+
+    if (!out->pcm || pcm_get_htimestamp(out->pcm, &avail, timestamp) < 0)
+        return -ENODATA;
+
+    size = pcm_get_buffer_size(out->pcm);
+    queued = (avail < size) ? size - avail : 0;
+    if (queued > out->written)
+        return -ENODATA;
+
+    *frames = ((out->written - queued) * out->android_config.sample_rate) /
+            out->config.rate;
+
+    return 0;
+}
 
 int hdmi_out_get_render_position(const struct audio_stream_out *stream,
 			   uint32_t *dsp_frames)
 {
+    hdmi_out_t *out = (hdmi_out_t*)stream;
+    struct timespec timestamp;
+    uint64_t frames;
+    int ret;
+
     TRACE();
-    return -EINVAL;
+
+    pthread_mutex_lock(&out->pos_lock);
+    ret = hdmi_out_get_played(out, &frames, &timestamp);
+    pthread_mutex_unlock(&out->pos_lock);
+
+    if (ret)
+        return -EINVAL;
+
+    *dsp_frames = (uint32_t)frames;
+    return 0;
+}
+
+int hdmi_out_get_presentation_position(const struct audio_stream_out *stream,
+                                       uint64_t *frames, struct timespec *timestamp)
+{
+    hdmi_out_t *out = (hdmi_out_t*)stream;
+    int ret;
+
+    TRACE();
+
+    pthread_mutex_lock(&out->pos_lock);
+    ret = hdmi_out_get_played(out, frames, timestamp);
+    pthread_mutex_unlock(&out->pos_lock);
+
+    return ret;
 }
 
 int hdmi_out_get_next_write_timestamp(const struct audio_stream_out *stream,
@@ -437,6 +911,7 @@ audio_stream_out_t hdmi_stream_out_descriptor = {
     .write = hdmi_out_write,
     .get_render_position = hdmi_out_get_render_position,
     .get_next_write_timestamp = hdmi_out_get_next_write_timestamp,
+    .get_presentation_position = hdmi_out_get_presentation_position,
 };
 
 /*****************************************************************
@@ -446,7 +921,13 @@ audio_stream_out_t hdmi_stream_out_descriptor = {
 
 static int hdmi_adev_close(struct hw_device_t *device)
 {
+    struct hdmi_device_t *adev = (struct hdmi_device_t *)device;
+
     TRACE();
+
+    pthread_mutex_destroy(&adev->streams_lock);
+    pthread_mutex_destroy(&adev->remap_lock);
+    free(device);
     return 0;
 }
 
@@ -502,26 +983,19 @@ static int hdmi_adev_set_parameters(audio_hw_device_t *dev, const char *kv_pairs
 {
     TRACEM("dev=%p kv_pairss='%s'", dev, kv_pairs);
 
-    struct str_parms *params;
-    char *str;
-    char value[HDMI_MAX_CHANNELS];
-    int ret, x, val, numMatch = 0;
+    struct audio_parms params;
+    unsigned int val;
+    int x;
     struct hdmi_device_t *adev = (struct hdmi_device_t *)dev;
 
-    params = str_parms_create_str(kv_pairs);
-    //Handle maximum of 8 channels
-    ret = str_parms_get_str(params, "channel_map", value, HDMI_MAX_CHANNELS);
-    if (ret >= 0) {
-        val = strtol(value, NULL, 10);
-        for(x = 0; x < HDMI_MAX_CHANNELS; x++) {
+    audio_parms_parse(&params, kv_pairs);
+    //Handle maximum of 8 channels, one nibble each
+    if (audio_parms_get_uint(&params, AUDIO_PARM_CHANNEL_MAP, &val) == 0) {
+        pthread_mutex_lock(&adev->remap_lock);
+        for(x = 0; x < HDMI_MAX_CHANNELS; x++)
             adev->map[x] = (val & (0xF << x*4)) >> x*4;
-            if (adev->map[x] == cea_channel_map[x])
-                numMatch += 1;
-        }
-        if (numMatch >= 5)
-            adev->CEAMap = true;
-        else
-            adev->CEAMap = false;
+        hdmi_publish_channel_map(adev);
+        pthread_mutex_unlock(&adev->remap_lock);
     }
     return 0;
 }
@@ -529,8 +1003,25 @@ static int hdmi_adev_set_parameters(audio_hw_device_t *dev, const char *kv_pairs
 static char* hdmi_adev_get_parameters(const audio_hw_device_t *dev,
                                       const char *keys)
 {
+    struct hdmi_device_t *adev = (struct hdmi_device_t *)dev;
+    struct audio_parms query;
+    char reply[64] = "";
+    unsigned int val = 0;
+    int x;
+
     TRACEM("dev=%p keys='%s'", dev, keys);
-    return NULL;
+
+    audio_parms_parse(&query, keys);
+
+    if (audio_parms_has(&query, AUDIO_PARM_CHANNEL_MAP)) {
+        pthread_mutex_lock(&adev->remap_lock);
+        for(x = 0; x < HDMI_MAX_CHANNELS; x++)
+            val |= (adev->map[x] & 0xF) << x*4;
+        pthread_mutex_unlock(&adev->remap_lock);
+        audio_parms_reply_uint(reply, sizeof(reply), AUDIO_PARM_CHANNEL_MAP, val);
+    }
+
+    return strdup(reply);
 }
 
 static size_t hdmi_adev_get_input_buffer_size(const audio_hw_device_t *dev,
@@ -548,6 +1039,66 @@ static size_t hdmi_adev_get_input_buffer_size(const audio_hw_device_t *dev,
         }                                       \
     }
 
+static int hdmi_cea_format(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_AC3:
+        return CEA_FORMAT_AC3;
+    case AUDIO_FORMAT_E_AC3:
+        return CEA_FORMAT_EAC3;
+#ifdef HAVE_AUDIO_FORMAT_DTS
+    case AUDIO_FORMAT_DTS:
+        return CEA_FORMAT_DTS;
+#endif
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Sets up compressed passthrough for out->android_config, provided the
+ * sink lists the format and the stream rate in its EDID.
+ */
+static int hdmi_out_init_passthrough(hdmi_out_t *out)
+{
+    audio_format_t format = out->android_config.format;
+    unsigned int rate = out->android_config.sample_rate;
+    const hdmi_sad_t *sad;
+    hdmi_audio_caps_t caps;
+    unsigned int link_rate;
+    int n;
+
+    if (hdmi_get_audio_caps(&caps)) {
+        ALOGE("Unable to get the HDMI audio capabilities");
+        return -ENODEV;
+    }
+
+    sad = hdmi_caps_find_format(&caps, hdmi_cea_format(format));
+    if (!sad) {
+        ALOGW("HDMI sink does not support format %x", format);
+        return -EINVAL;
+    }
+
+    for (n = 0 ; n < CEA_RATE_COUNT ; n++) {
+        if ((sad->rates & (1 << n)) && hdmi_cea_rate(n) == rate)
+            break;
+    }
+    link_rate = iec61937_link_rate(format, rate);
+    if (n == CEA_RATE_COUNT || !link_rate || link_rate > 192000) {
+        ALOGW("HDMI sink does not support format %x at %u Hz", format, rate);
+        return -EINVAL;
+    }
+
+    if (iec61937_init(&out->iec, format, rate))
+        return -ENOMEM;
+
+    out->passthrough = true;
+    out->config.rate = link_rate;
+    out->config.format = PCM_FORMAT_S16_LE;
+
+    return 0;
+}
+
 static int hdmi_adev_open_output_stream(audio_hw_device_t *dev,
                                         audio_io_handle_t handle,
                                         audio_devices_t devices,
@@ -555,6 +1106,7 @@ static int hdmi_adev_open_output_stream(audio_hw_device_t *dev,
                                         struct audio_config *config,
                                         struct audio_stream_out **stream_out)
 {
+    struct hdmi_device_t *adev = (struct hdmi_device_t *)dev;
     hdmi_out_t *out = 0;
     struct pcm_config *pcm_config = 0;
     struct audio_config *a_config = 0;
@@ -569,6 +1121,8 @@ static int hdmi_adev_open_output_stream(audio_hw_device_t *dev,
     out->dev = dev;
     memcpy(&out->stream_out, &hdmi_stream_out_descriptor,
            sizeof(audio_stream_out_t));
+    pthread_mutex_init(&out->pos_lock, NULL);
+    audio_sched_init(&out->sched, AUDIO_SCHED_HDMI);
     memcpy(&out->android_config, config, sizeof(audio_config_t));
 
     pcm_config = &out->config;
@@ -603,13 +1157,26 @@ static int hdmi_adev_open_output_stream(audio_hw_device_t *dev,
     case AUDIO_FORMAT_PCM_16_BIT:
         pcm_config->format = PCM_FORMAT_S16_LE;
         break;
+    case AUDIO_FORMAT_AC3:
+    case AUDIO_FORMAT_E_AC3:
+#ifdef HAVE_AUDIO_FORMAT_DTS
+    case AUDIO_FORMAT_DTS:
+#endif
+        if (hdmi_out_init_passthrough(out)) {
+            ALOGE("HDMI rejecting passthrough format %x", config->format);
+            goto fail;
+        }
+        break;
     default:
         ALOGE("HDMI rejecting format %x", config->format);
         goto fail;
     }
 
     a_config->channel_mask = config->channel_mask;
-    switch (config->channel_mask) {
+    if (out->passthrough) {
+        /* bursts are carried as 2ch PCM; the mask describes the content */
+        pcm_config->channels = 2;
+    } else switch (config->channel_mask) {
     case AUDIO_CHANNEL_OUT_STEREO:
         pcm_config->channels = 2;
         break;
@@ -630,6 +1197,14 @@ static int hdmi_adev_open_output_stream(audio_hw_device_t *dev,
         pcm_config->channels = 8;
     }
 
+    if (!out->passthrough) {
+        /* play at a rate the sink takes with this many channels, and
+         * tell the framework which
+         */
+        hdmi_out_select_rate(out, a_config->sample_rate);
+        config->sample_rate = a_config->sample_rate;
+    }
+
     //Allocating buffer for at most 8 channels
     out->buffcpy = malloc(pcm_config->period_size * sizeof(int16_t) * HDMI_MAX_CHANNELS);
     if (!out->buffcpy){
@@ -637,12 +1212,19 @@ static int hdmi_adev_open_output_stream(audio_hw_device_t *dev,
         goto fail;
     }
 
+    pthread_mutex_lock(&adev->streams_lock);
+    out->next = adev->streams;
+    adev->streams = out;
+    pthread_mutex_unlock(&adev->streams_lock);
+
     ALOGV("stream = %p", out);
     *stream_out = &out->stream_out;
 
     return 0;
 
 fail:
+    iec61937_release(&out->iec);
+    pthread_mutex_destroy(&out->pos_lock);
     free(out);
     return -ENOSYS;
 }
@@ -651,12 +1233,25 @@ static void hdmi_adev_close_output_stream(audio_hw_device_t *dev,
                                           struct audio_stream_out* stream_out)
 {
     hdmi_out_t *out = (hdmi_out_t*)stream_out;
+    struct hdmi_device_t *adev = (struct hdmi_device_t *)dev;
+    hdmi_out_t **p;
 
     TRACEM("dev=%p stream_out=%p", dev, stream_out);
 
+    pthread_mutex_lock(&adev->streams_lock);
+    for (p = &adev->streams; *p; p = &(*p)->next) {
+        if (*p == out) {
+            *p = out->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&adev->streams_lock);
+
     stream_out->common.standby((audio_stream_t*)stream_out);
+    iec61937_release(&out->iec);
     free(out->buffcpy);
     out->buffcpy = NULL;
+    pthread_mutex_destroy(&out->pos_lock);
     free(stream_out);
 }
 
@@ -711,13 +1306,27 @@ static int hdmi_adev_open(const hw_module_t* module,
                           const char* name,
                           hw_device_t** device)
 {
+    struct hdmi_device_t *adev;
+
     TRACE();
 
     if (strcmp(name, AUDIO_HARDWARE_INTERFACE) != 0)
         return -EINVAL;
 
-    hdmi_adev_descriptor.common.module = (struct hw_module_t *) module;
-    *device = &hdmi_adev_descriptor.common;
+    adev = calloc(1, sizeof(struct hdmi_device_t));
+    if (!adev)
+        return -ENOMEM;
+
+    memcpy(&adev->device, &hdmi_adev_descriptor, sizeof(audio_hw_device_t));
+    adev->device.common.module = (struct hw_module_t *) module;
+
+    /* no remapping until a channel_map says otherwise */
+    pthread_mutex_init(&adev->remap_lock, NULL);
+    pthread_mutex_init(&adev->streams_lock, NULL);
+    memcpy(adev->map, cea_channel_map, sizeof(adev->map));
+    compile_channel_remap(adev, &adev->remaps[0]);
+
+    *device = &adev->device.common;
 
     return 0;
 }
@@ -23,6 +23,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "hdmi_audio_hal.h"
 
@@ -72,11 +73,6 @@
  *****************************************************************
  */
 
-/* TODO: Figure this out dynamically, but ATM this is enforced
- * in the kernel.
- */
-#define HDMI_MAX_EDID 512
-
 #define EDID_BLOCK_SIZE       128
 #define EDID_BLOCK_MAP_ID     0xF0
 #define EDID_BLOCK_CEA_ID     0x02
@@ -89,12 +85,94 @@
 #define CEA_TAG_SPKRS (4 << 5)
 #define CEA_BIT_AUDIO (1 << 6)
 
-static void hdmi_dump_short_audio_descriptor_block(unsigned char *mem)
+static const unsigned int cea_rates[CEA_RATE_COUNT] = {
+    32000, 44100, 48000, 88200, 96000, 176400, 192000,
+};
+
+unsigned int hdmi_cea_rate(int n)
+{
+    return (n >= 0 && n < CEA_RATE_COUNT) ? cea_rates[n] : 0;
+}
+
+/*
+ * Returns the CEA_RATE_* bitmap of LPCM rates the sink takes with at
+ * least channels channels, over all its LPCM descriptors: a sink may
+ * list 8ch at 48 kHz only next to 2ch up to 192 kHz. Basic audio counts
+ * for stereo. If no descriptor has that many channels, returns the rates
+ * of every LPCM descriptor.
+ */
+int hdmi_caps_lpcm_rates(const hdmi_audio_caps_t *caps, int channels)
+{
+    int rates = 0, all = CEA_BASIC_AUDIO_RATES;
+    int n;
+
+    if (channels <= 2)
+        rates = CEA_BASIC_AUDIO_RATES;
+
+    for (n = 0 ; n < caps->num_sads ; n++) {
+        if (caps->sads[n].format != CEA_FORMAT_LPCM)
+            continue;
+        all |= caps->sads[n].rates;
+        if (caps->sads[n].max_channels >= channels)
+            rates |= caps->sads[n].rates;
+    }
+
+    return rates ? rates : all;
+}
+
+/*
+ * Picks, in order of preference: the content rate itself, so nothing is
+ * resampled; the lowest rate that is a multiple of it; the lowest rate
+ * above it; the highest rate of the sink. Only rates the sink takes with
+ * channels channels are considered.
+ */
+unsigned int hdmi_caps_select_rate(const hdmi_audio_caps_t *caps, unsigned int rate,
+                                   int channels)
+{
+    int rates = hdmi_caps_lpcm_rates(caps, channels);
+    unsigned int multiple = 0, above = 0, highest = 0, r;
+    int n;
+
+    for (n = 0 ; n < CEA_RATE_COUNT ; n++) {
+        if (!(rates & (1 << n)))
+            continue;
+        r = cea_rates[n];
+        if (r == rate)
+            return r;
+        if (rate && r > rate && !(r % rate) && !multiple)
+            multiple = r;
+        if (r > rate && !above)
+            above = r;
+        highest = r;
+    }
+
+    if (multiple)
+        return multiple;
+    return above ? above : highest;
+}
+
+const hdmi_sad_t *hdmi_caps_find_format(const hdmi_audio_caps_t *caps, int format)
+{
+    int n;
+
+    for (n = 0 ; n < caps->num_sads ; n++) {
+        if (caps->sads[n].format == format) {
+            return &caps->sads[n];
+        }
+    }
+
+    return NULL;
+}
+
+static void hdmi_parse_short_audio_descriptor_block(const unsigned char *mem,
+                                                    hdmi_audio_caps_t *caps)
 {
     const unsigned char FORMAT_MASK = 0x78;
     const unsigned char MAX_CH_MASK = 0x07;
-    int n, size;
-    unsigned char *p, *end, byte, format, chs;
+    int size;
+    const unsigned char *p, *end;
+    unsigned char byte, format, chs;
+    hdmi_sad_t *sad;
     const char* formats[] = {
         "Reserved (0)",
         "LPCM",
@@ -117,7 +195,7 @@ static void hdmi_dump_short_audio_descriptor_block(unsigned char *mem)
     size = *mem & CEA_SIZE_MASK;
     end = mem + 1 + size;
 
-    for (p = mem + 1 ; p < end ; p += 3) {
+    for (p = mem + 1 ; p + 3 <= end ; p += 3) {
         byte = p[0];
         format = (byte & FORMAT_MASK) >> 3;
         chs = byte & MAX_CH_MASK;
@@ -127,6 +205,13 @@ static void hdmi_dump_short_audio_descriptor_block(unsigned char *mem)
         ALOGV("  max channels: %d", chs + 1);
         ALOGV("  sample rates:");
 
+        if (caps->num_sads < HDMI_MAX_SADS) {
+            sad = &caps->sads[caps->num_sads++];
+        } else {
+            ALOGW("Ignoring short audio descriptor beyond %d", HDMI_MAX_SADS);
+            sad = NULL;
+        }
+
         byte = p[1];
         ALOGV_IF(byte & (1 << 0), "    32.0 kHz");
         ALOGV_IF(byte & (1 << 1), "    44.1 kHz");
@@ -136,41 +221,79 @@ static void hdmi_dump_short_audio_descriptor_block(unsigned char *mem)
         ALOGV_IF(byte & (1 << 5), "   176.4 kHz");
         ALOGV_IF(byte & (1 << 6), "   192.0 kHz");
 
+        if (sad) {
+            sad->format = format;
+            sad->max_channels = chs + 1;
+            sad->rates = byte & ((1 << CEA_RATE_COUNT) - 1);
+            sad->sample_sizes = 0;
+            sad->max_bitrate = 0;
+        }
+
         byte = p[2];
-        if ((format >= 2) && (format <= 8)) {
+        if (format == CEA_FORMAT_LPCM) {
+            ALOGV_IF(byte & CEA_LPCM_16BIT, "  16 bit");
+            ALOGV_IF(byte & CEA_LPCM_20BIT, "  20 bit");
+            ALOGV_IF(byte & CEA_LPCM_24BIT, "  24 bit");
+            if (sad) {
+                sad->sample_sizes = byte & 0x07;
+            }
+        } else if ((format >= 2) && (format <= 8)) {
             ALOGV("  max bit rate: %d kHz", ((int)byte) * 8);
+            if (sad) {
+                sad->max_bitrate = ((int)byte) * 8;
+            }
         }
     }
 }
 
-int hdmi_query_audio_caps(const char* edid_path, hdmi_audio_caps_t *caps)
+int hdmi_read_edid(const char* edid_path, unsigned char *edid, size_t size)
 {
     int fd;
-    unsigned char edid[HDMI_MAX_EDID];
     int status;
-    int index, n;
-    int nblocks;
-    int edid_size;
-
-    int has_audio = 0;
-    int speaker_alloc = 0;
-    int done = 0;
 
-    memset(edid, 0, sizeof(edid));
+    memset(edid, 0, size);
 
     fd = open(edid_path, O_RDONLY);
     if (fd == -1) {
         return -errno;
     }
 
-    status = read(fd, edid, sizeof(edid));
-    close(fd);
+    status = read(fd, edid, size);
     if (status == -1) {
         ALOGV("Error reading EDID");
-        return -errno;
+        status = -errno;
     } else {
         ALOGV("read %d bytes from edid file", status);
     }
+    close(fd);
+
+    return status;
+}
+
+/* FNV-1a */
+uint32_t hdmi_edid_hash(const unsigned char *edid, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= edid[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void hdmi_parse_audio_caps(const unsigned char *edid, hdmi_audio_caps_t *caps)
+{
+    int index, n;
+    int nblocks;
+    int edid_size;
+
+    int has_audio = 0;
+    int speaker_alloc = 0;
+
+    caps->num_sads = 0;
 
     nblocks = edid[0x7E];
     if (edid[EDID_BLOCK_SIZE] == EDID_BLOCK_MAP_ID) {
@@ -207,8 +330,7 @@ int hdmi_query_audio_caps(const char* edid_path, hdmi_audio_caps_t *caps)
 
                 switch (tag) {
                 case CEA_TAG_AUDIO:
-                    /* ignore for now, needed for bitstream. */
-                    hdmi_dump_short_audio_descriptor_block(&edid[index + n - 1]);
+                    hdmi_parse_short_audio_descriptor_block(&edid[index + n - 1], caps);
                     break;
                 case CEA_TAG_SPKRS: /* I think this fails... not sure why */
                     ALOGE_IF(size != 3, "CEA Speaker Allocation Block is wrong size "
@@ -228,6 +350,19 @@ int hdmi_query_audio_caps(const char* edid_path, hdmi_audio_caps_t *caps)
 
     caps->has_audio = has_audio;
     caps->speaker_alloc = speaker_alloc;
+}
+
+int hdmi_query_audio_caps(const char* edid_path, hdmi_audio_caps_t *caps)
+{
+    unsigned char edid[HDMI_MAX_EDID];
+    int status;
+
+    status = hdmi_read_edid(edid_path, edid, sizeof(edid));
+    if (status < 0) {
+        return status;
+    }
+
+    hdmi_parse_audio_caps(edid, caps);
 
     return 0;
 }
@@ -241,6 +376,7 @@ int main(int argc, char* argv[])
     hdmi_audio_caps_t caps = {
         .has_audio = 0,
     };
+    int n;
 
     if (argc < 2) {
         printf("usage: %s <edid-file>\n", argc ? argv[0] : prog_name);
@@ -259,6 +395,13 @@ int main(int argc, char* argv[])
     printf("caps = {\n");
     printf("  .has_audio = %d\n", caps.has_audio);
     printf("  .speaker_alloc = 0x%02x\n", caps.speaker_alloc);
+    printf("  .num_sads = %d\n", caps.num_sads);
+    for (n = 0 ; n < caps.num_sads ; n++) {
+        printf("  .sads[%d] = { .format = %d, .max_channels = %d, .rates = 0x%02x, "
+               ".sample_sizes = 0x%x, .max_bitrate = %d }\n", n,
+               caps.sads[n].format, caps.sads[n].max_channels, caps.sads[n].rates,
+               caps.sads[n].sample_sizes, caps.sads[n].max_bitrate);
+    }
     printf("}\n");
 
     return 0;
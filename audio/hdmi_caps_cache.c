@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hdmi_caps_cache"
+/* #define LOG_NDEBUG 0 */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "hdmi_audio_hal.h"
+#include "uevent_monitor.h"
+
+static pthread_mutex_t caps_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t caps_once = PTHREAD_ONCE_INIT;
+static hdmi_audio_caps_t cached_caps;
+static bool caps_valid;
+static bool caps_monitored;
+static uint32_t edid_hash;
+
+static void hdmi_hotplug_event(const struct uevent *event, void *arg __unused)
+{
+    if (strncmp(event->switch_name, "hdmi", 4) && !strstr(event->path, "omapdss"))
+        return;
+
+    ALOGV("HDMI hotplug (%s %s), dropping cached EDID", event->action, event->path);
+    pthread_mutex_lock(&caps_lock);
+    caps_valid = false;
+    pthread_mutex_unlock(&caps_lock);
+}
+
+static void caps_monitor_start(void)
+{
+    caps_monitored = !uevent_monitor_add(hdmi_hotplug_event, NULL);
+}
+
+int hdmi_get_audio_caps(hdmi_audio_caps_t *caps)
+{
+    unsigned char edid[HDMI_MAX_EDID];
+    uint32_t hash;
+    int ret = 0;
+
+    pthread_once(&caps_once, caps_monitor_start);
+
+    pthread_mutex_lock(&caps_lock);
+
+    if (!caps_valid || !caps_monitored) {
+        ret = hdmi_read_edid(HDMI_EDID_PATH, edid, sizeof(edid));
+        if (ret < 0) {
+            caps_valid = false;
+            goto done;
+        }
+
+        hash = hdmi_edid_hash(edid, ret);
+        if (!caps_valid || hash != edid_hash) {
+            hdmi_parse_audio_caps(edid, &cached_caps);
+            edid_hash = hash;
+            caps_valid = true;
+        }
+        ret = 0;
+    }
+
+    *caps = cached_caps;
+
+done:
+    pthread_mutex_unlock(&caps_lock);
+    return ret;
+}
@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hdmi_iec61937"
+/* #define LOG_NDEBUG 0 */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "hdmi_iec61937.h"
+
+/* Burst preamble sync words */
+#define IEC61937_PA 0xF872
+#define IEC61937_PB 0x4E1F
+#define IEC61937_PREAMBLE_BYTES 8
+
+/* Pc data types */
+#define IEC61937_AC3    0x01
+#define IEC61937_DTS1   0x0B
+#define IEC61937_DTS2   0x0C
+#define IEC61937_DTS3   0x0D
+#define IEC61937_EAC3   0x15
+
+/* Repetition periods, in 2ch frames at the link rate */
+#define AC3_PERIOD      1536
+#define EAC3_PERIOD     (4 * 1536)
+#define DTS_MAX_PERIOD  2048
+
+#define AC3_MAX_FRAME   4096
+#define DTS_MAX_FRAME   16384
+
+/* Bytes needed to parse any of the frame headers below */
+#define FRAME_HEADER_BYTES 8
+
+/* E-AC-3 bursts carry six audio blocks of the independent substream */
+#define EAC3_BURST_BLOCKS 6
+
+static const uint8_t ac3_sync[] = { 0x0B, 0x77 };
+#ifdef HAVE_AUDIO_FORMAT_DTS
+static const uint8_t dts_sync[] = { 0x7F, 0xFE, 0x80, 0x01 };
+#endif
+
+/* ATSC A/52 Table 5.18, indexed by frmsizecod / 2 */
+static const uint16_t ac3_bitrates[] = {
+    32, 40, 48, 56, 64, 80, 96, 112, 128, 160,
+    192, 224, 256, 320, 384, 448, 512, 576, 640,
+};
+static const uint16_t ac3_words_44100[] = {
+    69, 87, 104, 121, 139, 174, 208, 243, 278, 348,
+    417, 487, 557, 696, 835, 975, 1114, 1253, 1393,
+};
+
+static const int eac3_blocks[] = { 1, 2, 3, 6 };
+
+int iec61937_supported(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_AC3:
+    case AUDIO_FORMAT_E_AC3:
+#ifdef HAVE_AUDIO_FORMAT_DTS
+    case AUDIO_FORMAT_DTS:
+#endif
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+unsigned int iec61937_link_rate(audio_format_t format, unsigned int rate)
+{
+    switch (format) {
+    case AUDIO_FORMAT_AC3:
+#ifdef HAVE_AUDIO_FORMAT_DTS
+    case AUDIO_FORMAT_DTS:
+#endif
+        return rate;
+    case AUDIO_FORMAT_E_AC3:
+        return 4 * rate;
+    default:
+        return 0;
+    }
+}
+
+static size_t max_period(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_AC3:
+        return AC3_PERIOD;
+    case AUDIO_FORMAT_E_AC3:
+        return EAC3_PERIOD;
+    default:
+        return DTS_MAX_PERIOD;
+    }
+}
+
+int iec61937_init(struct iec61937 *iec, audio_format_t format, unsigned int rate)
+{
+    size_t frame_max;
+
+    memset(iec, 0, sizeof(*iec));
+
+    if (!iec61937_supported(format))
+        return -EINVAL;
+
+    iec->format = format;
+    iec->rate = rate;
+
+    frame_max = (format == AUDIO_FORMAT_AC3 || format == AUDIO_FORMAT_E_AC3) ?
+            AC3_MAX_FRAME : DTS_MAX_FRAME;
+    iec->frame = malloc(frame_max);
+    iec->burst = malloc(max_period(format) * 2 * sizeof(int16_t));
+    if (!iec->frame || !iec->burst) {
+        iec61937_release(iec);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void iec61937_release(struct iec61937 *iec)
+{
+    free(iec->frame);
+    free(iec->burst);
+    iec->frame = NULL;
+    iec->burst = NULL;
+}
+
+void iec61937_reset(struct iec61937 *iec)
+{
+    iec->frame_len = 0;
+    iec->frame_size = 0;
+    iec->payload = 0;
+    iec->burst_blocks = 0;
+}
+
+static int parse_ac3_header(struct iec61937 *iec)
+{
+    const uint8_t *h = iec->frame;
+    int bsid = h[5] >> 3;
+
+    if (bsid <= 10) {
+        int fscod = h[4] >> 6;
+        int frmsizecod = h[4] & 0x3f;
+        int words;
+
+        if (fscod == 3 || frmsizecod >= 38)
+            return -EINVAL;
+
+        switch (fscod) {
+        case 0: /* 48 kHz */
+            words = 2 * ac3_bitrates[frmsizecod >> 1];
+            break;
+        case 1: /* 44.1 kHz */
+            words = ac3_words_44100[frmsizecod >> 1] + (frmsizecod & 1);
+            break;
+        default: /* 32 kHz */
+            words = 3 * ac3_bitrates[frmsizecod >> 1];
+            break;
+        }
+
+        iec->frame_size = 2 * words;
+        iec->frame_blocks = EAC3_BURST_BLOCKS;
+        iec->frame_type = IEC61937_AC3 | ((h[5] & 0x07) << 8); /* bsmod */
+    } else if (bsid <= 16 && iec->format == AUDIO_FORMAT_E_AC3) {
+        int strmtyp = h[2] >> 6;
+        int frmsiz = ((h[2] & 0x07) << 8) | h[3];
+        int fscod = h[4] >> 6;
+
+        iec->frame_size = 2 * (frmsiz + 1);
+        if (strmtyp == 1) /* dependent substream */
+            iec->frame_blocks = 0;
+        else if (fscod == 3)
+            iec->frame_blocks = EAC3_BURST_BLOCKS;
+        else
+            iec->frame_blocks = eac3_blocks[(h[4] >> 4) & 0x03];
+    } else {
+        return -EINVAL;
+    }
+
+    /* AC-3 frames carried in an E-AC-3 stream go in E-AC-3 bursts */
+    if (iec->format == AUDIO_FORMAT_E_AC3)
+        iec->frame_type = IEC61937_EAC3;
+
+    iec->frame_period = max_period(iec->format);
+
+    return 0;
+}
+
+#ifdef HAVE_AUDIO_FORMAT_DTS
+static int parse_dts_header(struct iec61937 *iec)
+{
+    const uint8_t *h = iec->frame;
+    int nblks = ((h[4] & 0x01) << 6) | (h[5] >> 2);
+    int fsize = ((h[5] & 0x03) << 12) | (h[6] << 4) | (h[7] >> 4);
+
+    switch ((nblks + 1) * 32) {
+    case 512:
+        iec->frame_type = IEC61937_DTS1;
+        break;
+    case 1024:
+        iec->frame_type = IEC61937_DTS2;
+        break;
+    case 2048:
+        iec->frame_type = IEC61937_DTS3;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    iec->frame_size = fsize + 1;
+    iec->frame_blocks = 0;
+    iec->frame_period = (nblks + 1) * 32;
+
+    return 0;
+}
+#endif
+
+static int parse_header(struct iec61937 *iec)
+{
+    size_t frame_max;
+    int ret;
+
+#ifdef HAVE_AUDIO_FORMAT_DTS
+    if (iec->format == AUDIO_FORMAT_DTS) {
+        ret = parse_dts_header(iec);
+        frame_max = DTS_MAX_FRAME;
+    } else
+#endif
+    {
+        ret = parse_ac3_header(iec);
+        frame_max = AC3_MAX_FRAME;
+    }
+
+    if (!ret && (iec->frame_size < FRAME_HEADER_BYTES ||
+                 iec->frame_size > frame_max ||
+                 iec->frame_size > iec->frame_period * 4 - IEC61937_PREAMBLE_BYTES))
+        ret = -EINVAL;
+
+    if (ret)
+        iec->frame_size = 0;
+
+    return ret;
+}
+
+/*
+ * Fills in the preamble, converts the payload to 16-bit words and pads
+ * the burst to its repetition period. The payload was copied in stream
+ * byte order, so each word is built from its big-endian byte pair and
+ * stored in host (little-endian, i.e. S16_LE) order.
+ */
+static void finish_burst(struct iec61937 *iec)
+{
+    uint8_t *data = (uint8_t *)(iec->burst + 4);
+    size_t words = (iec->payload + 1) / 2;
+    size_t n;
+
+    if (iec->payload & 1)
+        data[iec->payload] = 0;
+
+    for (n = 0 ; n < words ; n++)
+        iec->burst[4 + n] = (data[2 * n] << 8) | data[2 * n + 1];
+
+    iec->burst[0] = IEC61937_PA;
+    iec->burst[1] = IEC61937_PB;
+    iec->burst[2] = iec->burst_type;
+    /* Pd is the payload length in bits, except for E-AC-3 */
+    iec->burst[3] = (iec->format == AUDIO_FORMAT_E_AC3) ?
+            iec->payload : iec->payload * 8;
+
+    iec->burst_size = iec->burst_period * 2 * sizeof(int16_t);
+    memset(iec->burst + 4 + words, 0,
+           iec->burst_size - IEC61937_PREAMBLE_BYTES - 2 * words);
+
+    iec->payload = 0;
+    iec->burst_blocks = 0;
+}
+
+/* Returns true if the burst must go out before the collected frame */
+static int burst_full(struct iec61937 *iec)
+{
+    if (!iec->payload)
+        return 0;
+
+    if (iec->payload + iec->frame_size >
+            iec->burst_period * 4 - IEC61937_PREAMBLE_BYTES)
+        return 1;
+
+    return iec->frame_blocks &&
+            iec->burst_blocks + iec->frame_blocks > EAC3_BURST_BLOCKS;
+}
+
+size_t iec61937_pack(struct iec61937 *iec, const void *buf, size_t bytes,
+                     const void **burst)
+{
+    const uint8_t *in = buf;
+    const uint8_t *sync;
+    size_t sync_len, used = 0, n;
+
+#ifdef HAVE_AUDIO_FORMAT_DTS
+    if (iec->format == AUDIO_FORMAT_DTS) {
+        sync = dts_sync;
+        sync_len = sizeof(dts_sync);
+    } else
+#endif
+    {
+        sync = ac3_sync;
+        sync_len = sizeof(ac3_sync);
+    }
+
+    *burst = NULL;
+
+    for (;;) {
+        if (!iec->frame_size) {
+            uint8_t byte;
+
+            if (used == bytes)
+                break;
+            byte = in[used++];
+
+            /* Hunt for the sync word, then collect the header */
+            if (iec->frame_len < sync_len && byte != sync[iec->frame_len]) {
+                iec->frame_len = 0;
+                if (byte != sync[0])
+                    continue;
+            }
+            iec->frame[iec->frame_len++] = byte;
+
+            if (iec->frame_len == FRAME_HEADER_BYTES && parse_header(iec)) {
+                if (!iec->dropped++)
+                    ALOGW("Dropping bad compressed frame header");
+                iec->frame_len = 0;
+            }
+            continue;
+        }
+
+        n = iec->frame_size - iec->frame_len;
+        if (n > bytes - used)
+            n = bytes - used;
+        memcpy(iec->frame + iec->frame_len, in + used, n);
+        iec->frame_len += n;
+        used += n;
+
+        if (iec->frame_len < iec->frame_size)
+            break;
+
+        /* A complete frame: it may have to wait for the next burst */
+        if (burst_full(iec)) {
+            finish_burst(iec);
+            *burst = iec->burst;
+            break;
+        }
+
+        if (!iec->payload) {
+            iec->burst_type = iec->frame_type;
+            iec->burst_period = iec->frame_period;
+        }
+        memcpy((uint8_t *)(iec->burst + 4) + iec->payload, iec->frame, iec->frame_size);
+        iec->payload += iec->frame_size;
+        iec->burst_blocks += iec->frame_blocks;
+        iec->frame_len = 0;
+        iec->frame_size = 0;
+
+        /*
+         * AC-3 and DTS bursts hold a single frame. E-AC-3 bursts are sent
+         * when the next independent frame arrives, so that dependent
+         * substream frames stay with their independent frame.
+         */
+        if (iec->format != AUDIO_FORMAT_E_AC3) {
+            finish_burst(iec);
+            *burst = iec->burst;
+            break;
+        }
+    }
+
+    return used;
+}
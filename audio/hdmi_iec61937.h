@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HDMI_IEC61937_H
+#define HDMI_IEC61937_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <system/audio.h>
+
+/*
+ * IEC 61937 packer for compressed passthrough over HDMI.
+ *
+ * Compressed frames are collected from an arbitrary byte stream and
+ * packed into data bursts: four 16-bit preamble words, the frame data
+ * in 16-bit big-endian words, and zero padding up to the repetition
+ * period of the format. Bursts are played as 2ch S16_LE PCM at the
+ * link rate given by iec61937_link_rate().
+ *
+ * Supported: AC-3, E-AC-3 and, when built with HAVE_AUDIO_FORMAT_DTS,
+ * 16-bit big-endian DTS core streams.
+ */
+
+struct iec61937 {
+    audio_format_t format;
+    unsigned int rate;      /* stream sample rate */
+
+    /* frame being collected */
+    uint8_t *frame;
+    size_t frame_len;
+    size_t frame_size;      /* 0 until the frame header is parsed */
+    uint16_t frame_type;    /* Pc word for the frame */
+    int frame_blocks;       /* E-AC-3: audio blocks in an independent frame */
+    size_t frame_period;    /* DTS: repetition period in frames */
+
+    /* burst being built; burst_size is set when it is handed out */
+    uint16_t *burst;
+    size_t burst_size;
+    size_t payload;         /* bytes of frame data in the burst */
+    uint16_t burst_type;
+    int burst_blocks;
+    size_t burst_period;
+
+    unsigned int dropped;   /* frames with a bad header, or too large */
+};
+
+/* Returns true if format can be packed */
+int iec61937_supported(audio_format_t format);
+
+/* Returns the link sample rate for format at stream rate, or 0 */
+unsigned int iec61937_link_rate(audio_format_t format, unsigned int rate);
+
+/* Returns 0, -EINVAL for an unsupported format, or -ENOMEM */
+int iec61937_init(struct iec61937 *iec, audio_format_t format, unsigned int rate);
+void iec61937_release(struct iec61937 *iec);
+
+/* Drops any partial frame and burst, e.g. on standby */
+void iec61937_reset(struct iec61937 *iec);
+
+/*
+ * Consumes up to bytes of compressed input and returns the number of
+ * bytes used. When a burst is complete, *burst points to it and
+ * iec->burst_size holds its length in bytes; the burst stays valid
+ * until the next call. Otherwise *burst is NULL and all input was used.
+ */
+size_t iec61937_pack(struct iec61937 *iec, const void *buf, size_t bytes,
+                     const void **burst);
+
+#endif /* HDMI_IEC61937_H */
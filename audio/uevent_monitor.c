@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_uevent"
+/* #define LOG_NDEBUG 0 */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/uevent.h>
+
+#include "uevent_monitor.h"
+
+#define UEVENT_MSG_LEN          2048
+#define UEVENT_SOCKET_BUF_SIZE  (64 * 1024)
+#define MAX_UEVENT_CALLBACKS    4
+
+static struct {
+    uevent_callback_t cb;
+    void *arg;
+} callbacks[MAX_UEVENT_CALLBACKS];
+
+static pthread_mutex_t monitor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t monitor_once = PTHREAD_ONCE_INIT;
+static int monitor_status = -ENODEV;
+static int monitor_fd = -1;
+
+static void parse_uevent(const char *msg, ssize_t len, struct uevent *event)
+{
+    const char *end = msg + len;
+
+    event->action = "";
+    event->path = "";
+    event->subsystem = "";
+    event->switch_name = "";
+    event->switch_state = "";
+
+    /* NUL-separated KEY=value strings, after an "action@path" header */
+    for (; msg < end; msg += strlen(msg) + 1) {
+        if (!strncmp(msg, "ACTION=", 7))
+            event->action = msg + 7;
+        else if (!strncmp(msg, "DEVPATH=", 8))
+            event->path = msg + 8;
+        else if (!strncmp(msg, "SUBSYSTEM=", 10))
+            event->subsystem = msg + 10;
+        else if (!strncmp(msg, "SWITCH_NAME=", 12))
+            event->switch_name = msg + 12;
+        else if (!strncmp(msg, "SWITCH_STATE=", 13))
+            event->switch_state = msg + 13;
+    }
+}
+
+static void *monitor_thread(void *arg __unused)
+{
+    char msg[UEVENT_MSG_LEN + 2];
+    struct uevent event;
+    ssize_t n;
+    int i;
+
+    for (;;) {
+        n = uevent_kernel_multicast_recv(monitor_fd, msg, UEVENT_MSG_LEN);
+        if (n <= 0)
+            continue;
+
+        msg[n] = '\0';
+        msg[n + 1] = '\0';
+        parse_uevent(msg, n, &event);
+
+        pthread_mutex_lock(&monitor_lock);
+        for (i = 0; i < MAX_UEVENT_CALLBACKS; i++)
+            if (callbacks[i].cb)
+                callbacks[i].cb(&event, callbacks[i].arg);
+        pthread_mutex_unlock(&monitor_lock);
+    }
+
+    return NULL;
+}
+
+static void monitor_start(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    monitor_fd = uevent_open_socket(UEVENT_SOCKET_BUF_SIZE, true);
+    if (monitor_fd < 0) {
+        monitor_status = -errno;
+        ALOGE("cannot open uevent socket: %s", strerror(errno));
+        return;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    monitor_status = -pthread_create(&thread, &attr, monitor_thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (monitor_status) {
+        ALOGE("cannot start uevent thread: %s", strerror(-monitor_status));
+        close(monitor_fd);
+        monitor_fd = -1;
+    }
+}
+
+int uevent_monitor_add(uevent_callback_t cb, void *arg)
+{
+    int i;
+
+    pthread_once(&monitor_once, monitor_start);
+    if (monitor_status)
+        return monitor_status;
+
+    pthread_mutex_lock(&monitor_lock);
+    for (i = 0; i < MAX_UEVENT_CALLBACKS; i++) {
+        if (!callbacks[i].cb) {
+            callbacks[i].cb = cb;
+            callbacks[i].arg = arg;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&monitor_lock);
+
+    return (i < MAX_UEVENT_CALLBACKS) ? 0 : -ENOSPC;
+}
+
+void uevent_monitor_remove(uevent_callback_t cb, void *arg)
+{
+    int i;
+
+    pthread_mutex_lock(&monitor_lock);
+    for (i = 0; i < MAX_UEVENT_CALLBACKS; i++) {
+        if (callbacks[i].cb == cb && callbacks[i].arg == arg) {
+            callbacks[i].cb = NULL;
+            callbacks[i].arg = NULL;
+        }
+    }
+    pthread_mutex_unlock(&monitor_lock);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UEVENT_MONITOR_H
+#define UEVENT_MONITOR_H
+
+/*
+ * Shared kernel uevent listener. A single thread per process reads the
+ * uevent netlink socket and hands every event to the registered
+ * callbacks, from that thread. Callbacks must be quick and must not call
+ * back into the monitor.
+ */
+
+struct uevent {
+    const char *action;       /* "add", "remove", "change", ... */
+    const char *path;         /* DEVPATH */
+    const char *subsystem;
+    const char *switch_name;  /* switch class events only, else "" */
+    const char *switch_state;
+};
+
+typedef void (*uevent_callback_t)(const struct uevent *event, void *arg);
+
+/*
+ * Registers cb, starting the listener thread on first use. Returns 0, or
+ * a negative errno if the listener is not running (e.g. no permission to
+ * open the socket), in which case no events will be delivered.
+ */
+int uevent_monitor_add(uevent_callback_t cb, void *arg);
+
+void uevent_monitor_remove(uevent_callback_t cb, void *arg);
+
+#endif /* UEVENT_MONITOR_H */
@@ -71,7 +71,8 @@ ADDITIONAL_BUILD_PROPERTIES += \
     ro.bq.gpu_to_cpu_unsupported=1 \
     media.stagefright.cache-params=18432/20480/15 \
     ro.ksm.default=1 \
-    camera2.portability.force_api=1
+    camera2.portability.force_api=1 \
+    ro.power.touch_boost=1
 
 PRODUCT_CHARACTERISTICS := tablet,nosdcard
 
@@ -128,7 +129,8 @@ PRODUCT_PACKAGES += \
 
 # Prebuilts
 PRODUCT_COPY_FILES += \
-    $(COMMON_FOLDER)/prebuilt/etc/gps.conf:/system/etc/gps.conf
+    $(COMMON_FOLDER)/prebuilt/etc/gps.conf:/system/etc/gps.conf \
+    $(COMMON_FOLDER)/prebuilt/etc/power_profiles.conf:/system/etc/power_profiles.conf
 
 $(call inherit-product-if-exists, vendor/amazon/omap4-common/omap4-common-vendor.mk)
 
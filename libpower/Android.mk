@@ -14,12 +14,34 @@
 
 LOCAL_PATH := $(call my-dir)
 
+power_src_files := power.c hotplug.c profiles.c stats.c thermal.c timer.c touch_boost.c tunables.c
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := power.$(TARGET_BOOTLOADER_BOARD_NAME)
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SRC_FILES := power.c
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SRC_FILES := $(power_src_files)
+LOCAL_SHARED_LIBRARIES := liblog libcutils
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(HOST_OS),linux)
+
+# Replays hint traces against the HAL on a fake sysfs tree, see
+# harness/power_replay.c. Run: power_replay [-p profiles] trace
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := power_replay
+LOCAL_SRC_FILES := $(power_src_files) harness/power_replay.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH) hardware/libhardware/include
+# bionic's sys/cdefs.h provides __unused on the device
+LOCAL_CFLAGS := -D__unused='__attribute__((__unused__))'
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_LDFLAGS := -Wl,--wrap=write,--wrap=pwrite,--wrap=pwrite64
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+endif
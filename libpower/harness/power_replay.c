@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host replay harness for the power HAL.
+ *
+ * Builds a fake sysfs tree in a temporary directory, points the HAL at it
+ * through POWER_HAL_ROOT, and replays a trace of hints and screen state
+ * changes against HAL_MODULE_INFO_SYM, linked in from the HAL sources. For
+ * every kind of event it reports the time spent in the HAL call and the
+ * number of writes to each node; writes made by the HAL's own timers
+ * between events are reported separately.
+ *
+ * A trace has one event per line, "<ms> <event> [<value>]", with ms
+ * counted from the start of the replay:
+ *
+ *   0 screen on
+ *   120 interaction
+ *   130 vsync 1
+ *   900 temp 82000
+ *   5000 idle
+ *
+ * Events are screen (on or off), interaction, vsync, low_power, launch,
+ * sustained, audio_start and audio_low_power, which take 1 or 0 where
+ * the hint has a state, temp, which sets the thermal zone to the value in
+ * millidegrees, and idle, which only lets time pass. Lines starting with
+ * # are ignored.
+ *
+ * The HAL's writes are caught by wrapping write() and pwrite() at link
+ * time. A pwrite() at offset 0 also truncates the file, as a sysfs store
+ * replaces the whole value.
+ */
+
+/* nftw() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <hardware/hardware.h>
+#include <hardware/power.h>
+
+#include "omap_power_hints.h"
+#include "profiles.h"
+#include "stats.h"
+#include "thermal.h"
+#include "tunables.h"
+
+#define MAX_FDS 256
+#define MAX_LINE 256
+
+extern struct power_module HAL_MODULE_INFO_SYM;
+
+ssize_t __real_write(int fd, const void *buf, size_t count);
+ssize_t __real_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t __real_pwrite64(int fd, const void *buf, size_t count, int64_t offset);
+
+struct node {
+    const char *path;
+    const char *value;
+    unsigned int writes;
+};
+
+/* An OMAP4460 at boot, idle and cool */
+static struct node nodes[] = {
+    { CPUFREQ_CPU0 "scaling_available_frequencies", "350000 700000 920000 1200000 \n", 0 },
+    { CPUFREQ_CPU0 "scaling_max_freq", "1200000\n", 0 },
+    { CPUFREQ_CPU0 "scaling_min_freq", "350000\n", 0 },
+    { CPUFREQ_CPU0 "stats/time_in_state", "350000 0\n700000 0\n920000 0\n1200000 0\n", 0 },
+    { CPUFREQ_INTERACTIVE "timer_rate", "20000\n", 0 },
+    { CPUFREQ_INTERACTIVE "min_sample_time", "80000\n", 0 },
+    { CPUFREQ_INTERACTIVE "hispeed_freq", "700000\n", 0 },
+    { CPUFREQ_INTERACTIVE "go_hispeed_load", "99\n", 0 },
+    { CPUFREQ_INTERACTIVE "above_hispeed_delay", "20000\n", 0 },
+    { CPUFREQ_INTERACTIVE "boostpulse", "", 0 },
+    { CPUFREQ_INTERACTIVE "boostpulse_duration", "80000\n", 0 },
+    { CPU1_ONLINE, "1\n", 0 },
+    { THERMAL_ROOT "/thermal_zone0/temp", "45000\n", 0 },
+    { "/proc/stat", "cpu  1000 0 1000 100000 0 0 0 0 0 0\n", 0 },
+};
+
+#define NUM_NODES (int)(sizeof(nodes) / sizeof(nodes[0]))
+#define TEMP_NODE (NUM_NODES - 2)
+
+enum event_type {
+    EVENT_SCREEN,
+    EVENT_HINT,
+    EVENT_TEMP,
+    EVENT_IDLE,
+};
+
+struct event {
+    const char *name;
+    enum event_type type;
+    int hint;
+    int has_value;
+    unsigned int count;
+    uint64_t total_us;
+    unsigned int max_us;
+    unsigned int writes[NUM_NODES];
+};
+
+static struct event events[] = {
+    { .name = "screen", .type = EVENT_SCREEN, .has_value = 1 },
+    { .name = "interaction", .type = EVENT_HINT, .hint = POWER_HINT_INTERACTION },
+    { .name = "vsync", .type = EVENT_HINT, .hint = POWER_HINT_VSYNC, .has_value = 1 },
+    { .name = "low_power", .type = EVENT_HINT, .hint = POWER_HINT_LOW_POWER, .has_value = 1 },
+    { .name = "launch", .type = EVENT_HINT, .hint = OMAP_POWER_HINT_LAUNCH, .has_value = 1 },
+    { .name = "sustained", .type = EVENT_HINT,
+      .hint = OMAP_POWER_HINT_SUSTAINED_PERFORMANCE, .has_value = 1 },
+    { .name = "audio_start", .type = EVENT_HINT, .hint = OMAP_POWER_HINT_AUDIO_START },
+    { .name = "audio_low_power", .type = EVENT_HINT,
+      .hint = OMAP_POWER_HINT_AUDIO_LOW_POWER, .has_value = 1 },
+    { .name = "temp", .type = EVENT_TEMP, .has_value = 1 },
+    { .name = "idle", .type = EVENT_IDLE },
+};
+
+#define NUM_EVENTS (int)(sizeof(events) / sizeof(events[0]))
+
+static char root[PATH_MAX];
+static pthread_mutex_t writes_lock = PTHREAD_MUTEX_INITIALIZER;
+/* node written through each fd; -1 not looked up yet, -2 not a node */
+static int fd_nodes[MAX_FDS];
+static unsigned int init_writes[NUM_NODES];
+static unsigned int timer_writes[NUM_NODES];
+
+static int node_of_fd(int fd) {
+    char link[32];
+    char path[PATH_MAX];
+    size_t root_len = strlen(root);
+    ssize_t len;
+    int i;
+
+    if (fd < 0 || fd >= MAX_FDS)
+        return -2;
+    if (fd_nodes[fd] != -1)
+        return fd_nodes[fd];
+
+    fd_nodes[fd] = -2;
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    len = readlink(link, path, sizeof(path) - 1);
+    if (len <= 0)
+        return -2;
+    path[len] = '\0';
+
+    if (strncmp(path, root, root_len))
+        return -2;
+    for (i = 0; i < NUM_NODES; i++)
+        if (!strcmp(path + root_len, nodes[i].path))
+            fd_nodes[fd] = i;
+
+    return fd_nodes[fd];
+}
+
+static void count_write(int fd) {
+    int node;
+
+    pthread_mutex_lock(&writes_lock);
+    node = node_of_fd(fd);
+    if (node >= 0)
+        nodes[node].writes++;
+    pthread_mutex_unlock(&writes_lock);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count) {
+    ssize_t ret = __real_write(fd, buf, count);
+
+    if (ret >= 0)
+        count_write(fd);
+    return ret;
+}
+
+ssize_t __wrap_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    ssize_t ret = __real_pwrite(fd, buf, count, offset);
+
+    if (ret >= 0) {
+        if (!offset && ftruncate(fd, ret))
+            perror("ftruncate");
+        count_write(fd);
+    }
+    return ret;
+}
+
+ssize_t __wrap_pwrite64(int fd, const void *buf, size_t count, int64_t offset) {
+    ssize_t ret = __real_pwrite64(fd, buf, count, offset);
+
+    if (ret >= 0) {
+        if (!offset && ftruncate(fd, ret))
+            perror("ftruncate");
+        count_write(fd);
+    }
+    return ret;
+}
+
+/* Moves the writes counted so far into totals */
+static void take_writes(unsigned int *totals) {
+    int i;
+
+    pthread_mutex_lock(&writes_lock);
+    for (i = 0; i < NUM_NODES; i++) {
+        totals[i] += nodes[i].writes;
+        nodes[i].writes = 0;
+    }
+    pthread_mutex_unlock(&writes_lock);
+}
+
+static int make_parents(char *path) {
+    char *p;
+
+    for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        if (mkdir(path, 0755) && errno != EEXIST) {
+            perror(path);
+            return -1;
+        }
+        *p = '/';
+    }
+
+    return 0;
+}
+
+/* Formats rel under the fake root into path, which is PATH_MAX long */
+static int root_path(char *path, const char *rel) {
+    if (snprintf(path, PATH_MAX, "%s%s", root, rel) >= PATH_MAX) {
+        fprintf(stderr, "%s%s: path too long\n", root, rel);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int put_file(const char *rel, const char *value, size_t len) {
+    char path[PATH_MAX];
+    FILE *f;
+
+    if (root_path(path, rel) || make_parents(path))
+        return -1;
+
+    f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fwrite(value, 1, len, f);
+    fclose(f);
+
+    return 0;
+}
+
+static int copy_file(const char *from, const char *rel) {
+    char buf[4096];
+    size_t len;
+    FILE *f;
+
+    f = fopen(from, "r");
+    if (!f) {
+        perror(from);
+        return -1;
+    }
+    len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    return put_file(rel, buf, len);
+}
+
+static int make_tree(const char *profiles) {
+    char stats[PATH_MAX];
+    int i;
+
+    if (snprintf(root, sizeof(root), "%s/power_replay.XXXXXX",
+                 getenv("TMPDIR") ?: "/tmp") >= (int)sizeof(root)) {
+        fprintf(stderr, "TMPDIR too long\n");
+        return -1;
+    }
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return -1;
+    }
+
+    for (i = 0; i < NUM_NODES; i++)
+        if (put_file(nodes[i].path, nodes[i].value, strlen(nodes[i].value)))
+            return -1;
+
+    if (profiles && copy_file(profiles, PROFILES_PATH))
+        return -1;
+
+    if (root_path(stats, STATS_PATH))
+        return -1;
+    return make_parents(stats);
+}
+
+static int remove_entry(const char *path, const struct stat *st __unused,
+                        int flag __unused, struct FTW *ftw __unused) {
+    return remove(path);
+}
+
+static int64_t elapsed_us(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+            (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void sleep_until(const struct timespec *start, long ms) {
+    struct timespec t = *start;
+
+    t.tv_sec += ms / 1000;
+    t.tv_nsec += (ms % 1000) * 1000000;
+    if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+    }
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+        ;
+}
+
+static void run_event(struct power_module *module, struct event *e, int value) {
+    struct timespec start;
+    char temp[16];
+    int64_t us;
+    int len;
+
+    take_writes(timer_writes);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    switch (e->type) {
+    case EVENT_SCREEN:
+        module->setInteractive(module, value);
+        break;
+    case EVENT_HINT:
+        module->powerHint(module, e->hint, e->has_value ? &value : NULL);
+        break;
+    case EVENT_TEMP:
+        len = snprintf(temp, sizeof(temp), "%d\n", value);
+        put_file(nodes[TEMP_NODE].path, temp, len);
+        break;
+    case EVENT_IDLE:
+        break;
+    }
+    us = elapsed_us(&start);
+
+    take_writes(e->writes);
+    e->count++;
+    e->total_us += us;
+    if (us > e->max_us)
+        e->max_us = us;
+}
+
+static int parse_value(const char *s, int *value) {
+    char *end;
+
+    if (!strcmp(s, "on")) {
+        *value = 1;
+        return 0;
+    }
+    if (!strcmp(s, "off")) {
+        *value = 0;
+        return 0;
+    }
+
+    *value = strtol(s, &end, 10);
+    return (end == s || *end) ? -1 : 0;
+}
+
+static int replay(struct power_module *module, FILE *trace, const char *name) {
+    struct timespec start;
+    char line[MAX_LINE];
+    char event[32], arg[32];
+    long ms;
+    int value, lineno = 0;
+    int i, n;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (fgets(line, sizeof(line), trace)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        n = sscanf(line, "%ld %31s %31s", &ms, event, arg);
+        if (n < 2)
+            goto bad;
+
+        for (i = 0; i < NUM_EVENTS && strcmp(events[i].name, event); i++)
+            ;
+        if (i == NUM_EVENTS || (events[i].has_value && n < 3))
+            goto bad;
+
+        value = 0;
+        if (n == 3 && parse_value(arg, &value))
+            goto bad;
+
+        sleep_until(&start, ms);
+        run_event(module, &events[i], value);
+    }
+
+    take_writes(timer_writes);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%d: bad event: %s", name, lineno, line);
+    return -1;
+}
+
+static void print_writes(const char *what, const unsigned int *writes) {
+    unsigned int total = 0;
+    int i;
+
+    for (i = 0; i < NUM_NODES; i++)
+        total += writes[i];
+    printf("%s: %u writes\n", what, total);
+
+    for (i = 0; i < NUM_NODES; i++)
+        if (writes[i])
+            printf("    %6u %s\n", writes[i], nodes[i].path);
+}
+
+static void report(void) {
+    char path[PATH_MAX];
+    char buf[4096];
+    struct event *e;
+    FILE *f;
+    size_t len;
+    int i;
+
+    printf("%-16s %6s %10s %10s\n", "event", "count", "avg us", "max us");
+    for (i = 0; i < NUM_EVENTS; i++) {
+        e = &events[i];
+        if (e->count)
+            printf("%-16s %6u %10llu %10u\n", e->name, e->count,
+                   (unsigned long long)(e->total_us / e->count), e->max_us);
+    }
+
+    printf("\n");
+    print_writes("init", init_writes);
+    for (i = 0; i < NUM_EVENTS; i++)
+        if (events[i].count)
+            print_writes(events[i].name, events[i].writes);
+    print_writes("timers", timer_writes);
+
+    /* the HAL's own report, from the last screen change */
+    if (root_path(path, STATS_PATH))
+        return;
+    f = fopen(path, "r");
+    if (!f)
+        return;
+    printf("\n%s:\n", STATS_PATH);
+    while ((len = fread(buf, 1, sizeof(buf), f)))
+        fwrite(buf, 1, len, stdout);
+    fclose(f);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [-k] [-p profiles] trace\n"
+            "  -k  keep the fake sysfs tree\n"
+            "  -p  profile file, instead of the built-in profiles\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    struct power_module *module = &HAL_MODULE_INFO_SYM;
+    const char *profiles = NULL;
+    FILE *trace;
+    int keep = 0;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "kp:")) != -1) {
+        switch (opt) {
+        case 'k':
+            keep = 1;
+            break;
+        case 'p':
+            profiles = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    trace = fopen(argv[optind], "r");
+    if (!trace) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    memset(fd_nodes, -1, sizeof(fd_nodes));
+    if (make_tree(profiles))
+        return 1;
+    setenv(POWER_HAL_ROOT_ENV, root, 1);
+
+    module->init(module);
+    take_writes(init_writes);
+
+    ret = replay(module, trace, argv[optind]);
+    fclose(trace);
+    if (!ret)
+        report();
+
+    /* the HAL's threads are still running; nothing is torn down */
+    if (keep)
+        printf("\nfake sysfs tree kept in %s\n", root);
+    else
+        nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+
+#include "hotplug.h"
+#include "timer.h"
+#include "tunables.h"
+
+#define PROC_STAT "/proc/stat"
+
+/* A screen briefly turned off, e.g. to check the time, keeps both cores */
+#define HOTPLUG_OFF_DELAY_MS 5000
+#define HOTPLUG_SAMPLE_MS 1000
+/* Load of the online CPUs, in percent, that brings CPU1 back and lets it go */
+#define HOTPLUG_UP_LOAD 80
+#define HOTPLUG_DOWN_LOAD 30
+#define HOTPLUG_UP_SAMPLES 2
+#define HOTPLUG_DOWN_SAMPLES 5
+
+static pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t hotplug_once = PTHREAD_ONCE_INIT;
+static struct power_timer hotplug_timer;
+
+static int screen_on = 1;
+static int cpu1_online = 1;
+static int off_pending; /* screen off, CPU1 not taken down yet */
+static int64_t offline_since_ms;
+static int samples; /* consecutive samples past the threshold */
+static unsigned long long last_busy, last_total;
+static struct hotplug_stats stats;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Returns the load of the online CPUs since the last call, in percent */
+static int cpu_load(void) {
+    unsigned long long user, nice, system, idle, iowait, irq, softirq;
+    unsigned long long busy, total;
+    char path[PATH_MAX];
+    char buf[256];
+    int fd, len, load = 0;
+
+    fd = open(power_path(PROC_STAT, path, sizeof(path)), O_RDONLY);
+    if (fd < 0)
+        return 0;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return 0;
+    buf[len] = '\0';
+
+    if (sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu",
+               &user, &nice, &system, &idle, &iowait, &irq, &softirq) != 7)
+        return 0;
+
+    busy = user + nice + system + irq + softirq;
+    total = busy + idle + iowait;
+    if (last_total && total > last_total)
+        load = (int)((busy - last_busy) * 100 / (total - last_total));
+    last_busy = busy;
+    last_total = total;
+
+    return load;
+}
+
+/* must be called with hotplug_lock held */
+static void set_cpu1(int online) {
+    if (online == cpu1_online)
+        return;
+
+    if (tunable_write(TUNABLE_CPU1_ONLINE, online ? "1" : "0") < 0)
+        return;
+
+    cpu1_online = online;
+    if (online) {
+        stats.single_core_ms += now_ms() - offline_since_ms;
+    } else {
+        offline_since_ms = now_ms();
+        stats.offlines++;
+    }
+    samples = 0;
+}
+
+static void hotplug_sample(void *arg __unused) {
+    int load;
+
+    pthread_mutex_lock(&hotplug_lock);
+
+    if (screen_on)
+        goto exit;
+
+    load = cpu_load();
+    if (off_pending) {
+        off_pending = 0;
+        set_cpu1(0);
+    } else if (!cpu1_online) {
+        samples = (load >= HOTPLUG_UP_LOAD) ? samples + 1 : 0;
+        if (samples >= HOTPLUG_UP_SAMPLES) {
+            ALOGV("CPU load %d%%, onlining CPU1", load);
+            set_cpu1(1);
+            if (cpu1_online)
+                stats.load_onlines++;
+        }
+    } else {
+        samples = (load <= HOTPLUG_DOWN_LOAD) ? samples + 1 : 0;
+        if (samples >= HOTPLUG_DOWN_SAMPLES)
+            set_cpu1(0);
+    }
+
+    power_timer_arm(&hotplug_timer, HOTPLUG_SAMPLE_MS);
+
+exit:
+    pthread_mutex_unlock(&hotplug_lock);
+}
+
+static void hotplug_init(void) {
+    power_timer_init(&hotplug_timer, hotplug_sample, NULL);
+}
+
+void hotplug_set_screen(int on) {
+    pthread_once(&hotplug_once, hotplug_init);
+
+    pthread_mutex_lock(&hotplug_lock);
+    screen_on = on;
+    if (on) {
+        power_timer_cancel(&hotplug_timer);
+        set_cpu1(1);
+    } else {
+        off_pending = 1;
+        samples = 0;
+        power_timer_arm(&hotplug_timer, HOTPLUG_OFF_DELAY_MS);
+    }
+    pthread_mutex_unlock(&hotplug_lock);
+}
+
+void hotplug_get_stats(struct hotplug_stats *st) {
+    pthread_mutex_lock(&hotplug_lock);
+    *st = stats;
+    st->cpu1_online = cpu1_online;
+    if (!cpu1_online)
+        st->single_core_ms += now_ms() - offline_since_ms;
+    pthread_mutex_unlock(&hotplug_lock);
+}
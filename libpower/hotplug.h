@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_HOTPLUG_H
+#define OMAP_POWER_HOTPLUG_H
+
+#include <stdint.h>
+
+/*
+ * CPU1 hotplug with the screen off. CPU1 goes offline once the screen
+ * has stayed off for HOTPLUG_OFF_DELAY_MS, and comes back when the
+ * screen turns on or when CPU0 stays busy for HOTPLUG_UP_SAMPLES load
+ * samples in a row. It is taken down again after HOTPLUG_DOWN_SAMPLES
+ * quiet samples.
+ */
+
+struct hotplug_stats {
+    int cpu1_online;
+    int64_t single_core_ms; /* time spent with CPU1 offline */
+    unsigned int offlines;  /* times CPU1 was taken offline */
+    unsigned int load_onlines; /* of those, times load brought it back */
+};
+
+/* Called on every screen state change */
+void hotplug_set_screen(int on);
+
+void hotplug_get_stats(struct hotplug_stats *stats);
+
+#endif /* OMAP_POWER_HOTPLUG_H */
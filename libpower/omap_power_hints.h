@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_HINTS_H
+#define OMAP_POWER_HINTS_H
+
+/*
+ * Vendor hints other OMAP4 HALs pass to power_module_t.powerHint(), in
+ * addition to the framework's power_hint_t values. They are kept well
+ * clear of the framework range.
+ *
+ * The caller loads the power module itself with hw_get_module(), so the
+ * hints are handled by a separate instance of the module that has not
+ * been through init(); handlers must not rely on state set up there.
+ */
+
+/* A stream is starting; data is unused. Requests a short boost so that
+ * pcm_open() and resampler setup complete quickly. */
+#define OMAP_POWER_HINT_AUDIO_START       0x00001000
+
+/* Steady playback with the screen off; data points to an int, 1 when
+ * such playback starts and 0 when it ends. While on, the audio_low_power
+ * profile applies, in the module instance that owns the profiles. */
+#define OMAP_POWER_HINT_AUDIO_LOW_POWER   0x00001001
+
+/* An app is launching; data is NULL or points to an int, 1 when the
+ * launch starts and 0 when its first frame is drawn. Holds the launch
+ * profile until the end, or for at most LAUNCH_BOOST_MS. */
+#define OMAP_POWER_HINT_LAUNCH            0x00001002
+
+/* data points to an int, 1 to enter and 0 to leave sustained
+ * performance mode: a fixed, thermally sustainable frequency cap for
+ * long running workloads such as games. */
+#define OMAP_POWER_HINT_SUSTAINED_PERFORMANCE 0x00001003
+
+#endif /* OMAP_POWER_HINTS_H */
@@ -14,208 +14,522 @@
  * limitations under the License.
  */
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 
 #define LOG_TAG "TI OMAP PowerHAL"
 #include <utils/Log.h>
+#include <cutils/atomic.h>
 
 #include <hardware/hardware.h>
 #include <hardware/power.h>
 
-#define CPUFREQ_INTERACTIVE "/sys/devices/system/cpu/cpufreq/interactive/"
-#define CPUFREQ_CPU0 "/sys/devices/system/cpu/cpu0/cpufreq/"
+#include "hotplug.h"
+#include "omap_power_hints.h"
+#include "profiles.h"
+#include "stats.h"
+#include "thermal.h"
+#include "timer.h"
+#include "touch_boost.h"
+#include "tunables.h"
+
 #define BOOSTPULSE_PATH (CPUFREQ_INTERACTIVE "boostpulse")
 
-#define MAX_FREQ_NUMBER 10
-#define NOM_FREQ_INDEX 2
+/* interactive governor default, for kernels without boostpulse_duration */
+#define BOOSTPULSE_DURATION_DEFAULT_MS 80
+/*
+ * A pulse is suppressed while the previous one has more than this left
+ * to run: one governor sample, so that a steady stream of interactions
+ * renews the boost before it lapses.
+ */
+#define BOOSTPULSE_RENEW_MS 20
+
+/* Longest launch boost, for launches whose end is never hinted */
+#define LAUNCH_BOOST_MS 3000
+
+/*
+ * The vsync floor outlives vsync by a few frames, so that the gaps
+ * between back to back animations do not drop and raise it again.
+ */
+#define VSYNC_RELEASE_MS 100
+
+/* Power modes selected through hints, stacked on the screen state */
+#define MODE_SUSTAINED  (1 << 0)
+#define MODE_LAUNCH     (1 << 1)
+#define MODE_LOW_POWER  (1 << 2)
+#define MODE_VSYNC      (1 << 3)
+#define MODE_AUDIO_LOW_POWER (1 << 4)
+
+static const char *mode_names[] = {
+    "sustained", "launch", "low_power", "vsync", "audio_low_power",
+};
 
-static int freq_num;
-static char *freq_list[MAX_FREQ_NUMBER];
-static char *max_freq, *nom_freq;
-char current_max_freq[10];
+static struct freq_table freq_table;
+static struct power_profiles profiles;
+static char profiles_path_buf[PATH_MAX];
+static const char *profiles_path;
+/* frequency caps in force before a profile overrode them */
+static int saved_caps[PROFILE_KEY_COUNT] = {
+    [0 ... PROFILE_KEY_COUNT - 1] = PROFILE_UNSET,
+};
 
 struct omap_power_module {
     struct power_module base;
     pthread_mutex_t lock;
-    int boostpulse_fd;
-    int boostpulse_warned;
+    volatile int32_t boostpulse_fd;
+    volatile int32_t boostpulse_warned;
+    volatile int32_t boost_duration_ms; /* 0 until read from the governor */
+    volatile int32_t boost_last_ms;     /* CLOCK_MONOTONIC of the last pulse */
+    volatile int32_t boosts_issued;
+    volatile int32_t boosts_suppressed;
+    int screen_on;
+    int modes;
+    int vsync_on;
+    int thermal_steps; /* frequency steps the thermal cap drops */
+    struct power_timer launch_timer;
+    struct power_timer vsync_timer;
+    struct power_timer stats_timer;
     int inited;
 };
 
-static int str_to_tokens(char *str, char **token, int max_token_idx) {
-    char *pos, *start_pos = str;
-    char *token_pos;
-    int token_idx = 0;
+/* Returns the thermal frequency cap, or 0 if there is none */
+static int thermal_cap_freq(struct omap_power_module *omap_device) {
+    int i, nom;
 
-    if (!str || !token || !max_token_idx) {
+    if (!omap_device->thermal_steps)
         return 0;
-    }
-
-    do {
-        token_pos = strtok_r(start_pos, " \t\r\n", &pos);
 
-        if (token_pos)
-            token[token_idx++] = strdup(token_pos);
-        start_pos = NULL;
-    } while (token_pos && token_idx < max_token_idx);
+    /* never below the nominal frequency, which is always sustainable */
+    for (nom = 0; nom < freq_table.num - 1 && freq_table.freqs[nom] < freq_table.nom; nom++)
+        ;
+    i = freq_table.num - 1 - omap_device->thermal_steps;
+    return freq_table.freqs[(i < nom) ? nom : i];
+}
 
-    return token_idx;
+static int profile_key_is_cap(int key) {
+    return key == PROFILE_MAX_FREQ || key == PROFILE_MIN_FREQ;
 }
 
-static void sysfs_write(char *path, char *s) {
-    char buf[80];
-    int len;
-    int fd = open(path, O_WRONLY);
+/*
+ * Writes the interactive profile with the profiles for the current state
+ * on top. A frequency cap that no profile sets goes back to what it was
+ * before one did. reason goes to the switch history and start, if not
+ * NULL, is when the hint that caused the switch arrived. Must be called
+ * with the module lock held.
+ */
+static void apply_profiles(struct omap_power_module *omap_device, const char *reason,
+                           const struct timespec *start) {
+    struct profile p = profiles.profiles[PROFILE_INTERACTIVE];
+    int retry[PROFILE_KEY_COUNT];
+    char value[16];
+    int thermal_cap, thermal_only = 0;
+    int key, v;
+
+    if (profiles_changed(&profiles, profiles_path)) {
+        ALOGI("%s changed, reloading", profiles_path);
+        profiles_load(&profiles, profiles_path, &freq_table);
+    }
 
-    if (fd < 0) {
-        strerror_r(errno, buf, sizeof(buf));
-        ALOGE("Error opening %s: %s\n", path, buf);
-        return;
+    if (!omap_device->screen_on)
+        profile_merge(&p, &profiles.profiles[PROFILE_SCREEN_OFF]);
+    if (omap_device->modes & MODE_SUSTAINED)
+        profile_merge(&p, &profiles.profiles[PROFILE_SUSTAINED]);
+    /* nothing to render or launch onto with the screen off */
+    if (omap_device->screen_on) {
+        if (omap_device->modes & MODE_VSYNC)
+            profile_merge(&p, &profiles.profiles[PROFILE_VSYNC]);
+        if (omap_device->modes & MODE_LAUNCH)
+            profile_merge(&p, &profiles.profiles[PROFILE_LAUNCH]);
+    } else if (omap_device->modes & MODE_AUDIO_LOW_POWER) {
+        profile_merge(&p, &profiles.profiles[PROFILE_AUDIO_LOW_POWER]);
     }
+    if (omap_device->modes & MODE_LOW_POWER)
+        profile_merge(&p, &profiles.profiles[PROFILE_LOW_POWER]);
 
-    len = write(fd, s, strlen(s));
-    if (len < 0) {
-        strerror_r(errno, buf, sizeof(buf));
-        ALOGE("Error writing to %s: %s\n", path, buf);
+    /*
+     * The thermal cap also applies when no profile caps the frequency, but
+     * then must not raise a lower cap the user had set.
+     */
+    thermal_cap = thermal_cap_freq(omap_device);
+    if (thermal_cap) {
+        if (p.values[PROFILE_MAX_FREQ] == PROFILE_UNSET)
+            thermal_only = 1;
+        if (thermal_only || p.values[PROFILE_MAX_FREQ] > thermal_cap)
+            p.values[PROFILE_MAX_FREQ] = thermal_cap;
+        if (p.values[PROFILE_HISPEED_FREQ] > thermal_cap)
+            p.values[PROFILE_HISPEED_FREQ] = thermal_cap;
     }
 
-    close(fd);
-}
+    /* a later profile's cap wins over an earlier one's floor */
+    if (p.values[PROFILE_MAX_FREQ] != PROFILE_UNSET &&
+            p.values[PROFILE_MIN_FREQ] > p.values[PROFILE_MAX_FREQ])
+        p.values[PROFILE_MIN_FREQ] = p.values[PROFILE_MAX_FREQ];
+
+    for (key = 0; key < PROFILE_KEY_COUNT; key++) {
+        v = p.values[key];
+        retry[key] = PROFILE_UNSET;
+
+        if (profile_key_is_cap(key)) {
+            if (v == PROFILE_UNSET) {
+                v = saved_caps[key];
+                saved_caps[key] = PROFILE_UNSET;
+            } else if (saved_caps[key] == PROFILE_UNSET) {
+                if (tunable_read(profile_key_tunable(key), value, sizeof(value)) > 0)
+                    saved_caps[key] = atoi(value);
+                else
+                    saved_caps[key] = (key == PROFILE_MAX_FREQ) ?
+                            freq_table.max : freq_table.freqs[0];
+            }
+            if (key == PROFILE_MAX_FREQ && thermal_only && saved_caps[key] < v)
+                v = saved_caps[key];
+        }
 
-static int sysfs_read(char *path, char *s, int s_size) {
-    char buf[80];
-    int len, i;
-    int fd;
+        if (v == PROFILE_UNSET)
+            continue;
 
-    if (!path || !s || !s_size) {
-        return -1;
+        snprintf(value, sizeof(value), "%d", v);
+        if (tunable_write(profile_key_tunable(key), value) < 0 && profile_key_is_cap(key))
+            retry[key] = v;
     }
 
-    fd = open(path, O_RDONLY);
-    if (fd < 0) {
-        strerror_r(errno, buf, sizeof(buf));
-        ALOGE("Error opening %s: %s\n", path, buf);
-        return fd;
+    /* a cap cannot cross the other one until that one has moved */
+    for (key = 0; key < PROFILE_KEY_COUNT; key++) {
+        if (retry[key] == PROFILE_UNSET)
+            continue;
+        snprintf(value, sizeof(value), "%d", retry[key]);
+        tunable_write(profile_key_tunable(key), value);
     }
 
-    len = read(fd, s, s_size-1);
-    if (len < 0) {
-        strerror_r(errno, buf, sizeof(buf));
-        ALOGE("Error reading from %s: %s\n", path, buf);
-    } else {
-        s[len] = '\0';
-    }
+    stats_profile_switch(reason, omap_device->screen_on, omap_device->modes,
+                         omap_device->thermal_steps);
+    if (start)
+        stats_latency(STATS_LATENCY_PROFILE, start);
+}
 
-    close(fd);
-    return len;
+static void boostpulse(struct omap_power_module *omap_device);
+static void write_stats(void *arg);
+
+static void touch_boost(void *arg) {
+    boostpulse((struct omap_power_module *)arg);
 }
 
-static void omap_power_init(struct power_module *module) {
-    struct omap_power_module *omap_device = (struct omap_power_module *) module;
-    int tmp;
-    char freq_buf[MAX_FREQ_NUMBER*10];
+static void set_mode(struct omap_power_module *omap_device, int mode, int on,
+                     const struct timespec *start) {
+    int modes = on ? (omap_device->modes | mode) : (omap_device->modes & ~mode);
 
-    tmp = sysfs_read(CPUFREQ_CPU0 "scaling_available_frequencies", freq_buf, sizeof(freq_buf));
-    if (tmp <= 0) {
+    if (modes == omap_device->modes)
         return;
+
+    omap_device->modes = modes;
+    apply_profiles(omap_device, mode_names[__builtin_ctz(mode)], start);
+}
+
+static void launch_timeout(void *arg) {
+    struct omap_power_module *omap_device = (struct omap_power_module *)arg;
+
+    pthread_mutex_lock(&omap_device->lock);
+    /* a launch hinted meanwhile has re-armed the timer */
+    if (!omap_device->launch_timer.armed)
+        set_mode(omap_device, MODE_LAUNCH, 0, NULL);
+    pthread_mutex_unlock(&omap_device->lock);
+}
+
+static void vsync_release(void *arg) {
+    struct omap_power_module *omap_device = (struct omap_power_module *)arg;
+
+    pthread_mutex_lock(&omap_device->lock);
+    if (!omap_device->vsync_on)
+        set_mode(omap_device, MODE_VSYNC, 0, NULL);
+    pthread_mutex_unlock(&omap_device->lock);
+}
+
+/* Raises the floor as soon as vsync starts, drops it once it has stopped */
+static void vsync_hint(struct omap_power_module *omap_device, int on,
+                       const struct timespec *start) {
+    pthread_mutex_lock(&omap_device->lock);
+    omap_device->vsync_on = on;
+    if (on) {
+        power_timer_cancel(&omap_device->vsync_timer);
+        set_mode(omap_device, MODE_VSYNC, 1, start);
+    } else if (omap_device->modes & MODE_VSYNC) {
+        power_timer_arm(&omap_device->vsync_timer, VSYNC_RELEASE_MS);
     }
+    pthread_mutex_unlock(&omap_device->lock);
+}
+
+static void thermal_changed(int steps, void *arg) {
+    struct omap_power_module *omap_device = (struct omap_power_module *)arg;
 
-    tmp = sysfs_read(CPUFREQ_CPU0 "scaling_max_freq", current_max_freq, sizeof(current_max_freq));
-    if (tmp <= 0) {
-        ALOGE("Error reading scaling_max_freq\n");
+    pthread_mutex_lock(&omap_device->lock);
+    if (steps != omap_device->thermal_steps) {
+        omap_device->thermal_steps = steps;
+        apply_profiles(omap_device, "thermal", NULL);
     }
+    pthread_mutex_unlock(&omap_device->lock);
+}
 
-    freq_num = str_to_tokens(freq_buf, freq_list, MAX_FREQ_NUMBER);
-    if (!freq_num) {
+static void omap_power_init(struct power_module *module) {
+    struct omap_power_module *omap_device = (struct omap_power_module *) module;
+
+    pthread_mutex_lock(&omap_device->lock);
+
+    if (freq_table_load(&freq_table)) {
+        ALOGE("Error reading scaling_available_frequencies\n");
+        pthread_mutex_unlock(&omap_device->lock);
         return;
     }
 
-    max_freq = freq_list[freq_num - 1];
-    tmp = (NOM_FREQ_INDEX > freq_num) ? freq_num : NOM_FREQ_INDEX;
-    nom_freq = freq_list[tmp - 1];
-
-    sysfs_write(CPUFREQ_INTERACTIVE "timer_rate", "20000");
-    sysfs_write(CPUFREQ_INTERACTIVE "min_sample_time","60000");
-    sysfs_write(CPUFREQ_INTERACTIVE "hispeed_freq", nom_freq);
-    sysfs_write(CPUFREQ_INTERACTIVE "go_hispeed_load", "50");
-    sysfs_write(CPUFREQ_INTERACTIVE "above_hispeed_delay", "100000");
+    profiles_path = power_path(PROFILES_PATH, profiles_path_buf, sizeof(profiles_path_buf));
+    profiles_load(&profiles, profiles_path, &freq_table);
+    omap_device->screen_on = 1;
+    power_timer_init(&omap_device->launch_timer, launch_timeout, omap_device);
+    power_timer_init(&omap_device->vsync_timer, vsync_release, omap_device);
+    power_timer_init(&omap_device->stats_timer, write_stats, omap_device);
+    apply_profiles(omap_device, "init", NULL);
 
     ALOGI("Initialized successfully");
     omap_device->inited = 1;
+    pthread_mutex_unlock(&omap_device->lock);
+
+    touch_boost_start(touch_boost, omap_device);
+    thermal_start(thermal_changed, omap_device);
 }
 
 static int boostpulse_open(struct omap_power_module *omap_device) {
+    char path[PATH_MAX];
     char buf[80];
+    int fd = android_atomic_acquire_load(&omap_device->boostpulse_fd);
 
-    pthread_mutex_lock(&omap_device->lock);
-
-    if (omap_device->boostpulse_fd < 0) {
-        omap_device->boostpulse_fd = open(BOOSTPULSE_PATH, O_WRONLY);
+    if (fd >= 0)
+        return fd;
 
-        if (omap_device->boostpulse_fd < 0) {
-            if (!omap_device->boostpulse_warned) {
-                strerror_r(errno, buf, sizeof(buf));
-                ALOGE("Error opening %s: %s\n", BOOSTPULSE_PATH, buf);
-                omap_device->boostpulse_warned = 1;
-            }
+    fd = open(power_path(BOOSTPULSE_PATH, path, sizeof(path)), O_WRONLY);
+    if (fd < 0) {
+        if (!android_atomic_acquire_cas(0, 1, &omap_device->boostpulse_warned)) {
+            strerror_r(errno, buf, sizeof(buf));
+            ALOGE("Error opening %s: %s\n", BOOSTPULSE_PATH, buf);
         }
+        return fd;
     }
 
-    pthread_mutex_unlock(&omap_device->lock);
-    return omap_device->boostpulse_fd;
+    /* keep whichever fd was published first */
+    if (android_atomic_release_cas(-1, fd, &omap_device->boostpulse_fd)) {
+        close(fd);
+        fd = android_atomic_acquire_load(&omap_device->boostpulse_fd);
+    }
+
+    return fd;
+}
+
+static int32_t boost_duration_ms(struct omap_power_module *omap_device) {
+    int32_t duration = android_atomic_acquire_load(&omap_device->boost_duration_ms);
+    char buf[16];
+
+    if (duration)
+        return duration;
+
+    if (tunable_read(TUNABLE_BOOSTPULSE_DURATION, buf, sizeof(buf)) > 0)
+        duration = atoi(buf) / 1000;
+    if (duration <= 0)
+        duration = BOOSTPULSE_DURATION_DEFAULT_MS;
+
+    android_atomic_release_store(duration, &omap_device->boost_duration_ms);
+    return duration;
+}
+
+/* Runs on the timer thread, off the setInteractive() path */
+static void write_stats(void *arg) {
+    struct omap_power_module *omap_device = (struct omap_power_module *) arg;
+    struct hotplug_stats hotplug;
+    char path[PATH_MAX];
+    int fd;
+
+    fd = open(power_path(STATS_PATH, path, sizeof(path)), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+
+    dprintf(fd, "boostpulse: %d issued, %d suppressed\n",
+            android_atomic_acquire_load(&omap_device->boosts_issued),
+            android_atomic_acquire_load(&omap_device->boosts_suppressed));
+
+    hotplug_get_stats(&hotplug);
+    dprintf(fd, "cpu1: %s, %u offlines (%u undone by load), %lld s single core\n\n",
+            hotplug.cpu1_online ? "online" : "offline", hotplug.offlines,
+            hotplug.load_onlines, (long long)(hotplug.single_core_ms / 1000));
+
+    stats_dump(fd);
+    close(fd);
 }
 
 static void omap_power_set_interactive(struct power_module *module, int on) {
     struct omap_power_module *omap_device = (struct omap_power_module *) module;
-    int tmp;
+    struct timespec start;
 
     if (!omap_device->inited)
         return;
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats_screen_changed(on);
+
     /*
-     * Lower maximum frequency when screen is off.  CPU 0 and 1 share a
-     * cpufreq policy.
+     * The screen_off profile lowers the maximum frequency by default.
+     * CPU 0 and 1 share a cpufreq policy.
      */
+    pthread_mutex_lock(&omap_device->lock);
+    omap_device->screen_on = on;
+    apply_profiles(omap_device, "screen", &start);
+    pthread_mutex_unlock(&omap_device->lock);
 
-    // sysfs_write(CPUFREQ_CPU0 "scaling_max_freq", on ? max_freq : nom_freq);
-    if (on) {
-        sysfs_write(CPUFREQ_CPU0 "scaling_max_freq", (strlen(current_max_freq) > 0) ? current_max_freq : max_freq);
-    } else {
-        tmp = sysfs_read(CPUFREQ_CPU0 "scaling_max_freq", current_max_freq, sizeof(current_max_freq));
-        if (tmp <= 0) {
-            ALOGE("Error reading scaling_max_freq\n");
-        }
-        sysfs_write(CPUFREQ_CPU0 "scaling_max_freq", nom_freq);
+    hotplug_set_screen(on);
+
+    /* the screen_off profile caps the CPU well below any thermal limit */
+    if (on)
+        thermal_start(thermal_changed, omap_device);
+    else
+        thermal_stop();
+
+    power_timer_arm(&omap_device->stats_timer, 0);
+}
+
+/*
+ * Interactions arrive for every batch of input events; pulse only when the
+ * boost from the previous pulse is about to run out. Concurrent callers
+ * race on boost_last_ms and only the winner writes.
+ */
+static void boostpulse(struct omap_power_module *omap_device) {
+    char buf[80];
+    struct timespec start;
+    int32_t now;
+    int32_t last = android_atomic_acquire_load(&omap_device->boost_last_ms);
+    int fd;
+    int len;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    /* wraps, only differences matter */
+    now = (int32_t)((int64_t)start.tv_sec * 1000 + start.tv_nsec / 1000000);
+
+    if (last && now - last < boost_duration_ms(omap_device) - BOOSTPULSE_RENEW_MS) {
+        android_atomic_inc(&omap_device->boosts_suppressed);
+        return;
+    }
+
+    /* 0 means no pulse yet */
+    if (!now)
+        now = 1;
+    if (android_atomic_release_cas(last, now, &omap_device->boost_last_ms)) {
+        android_atomic_inc(&omap_device->boosts_suppressed);
+        return;
+    }
+
+    fd = boostpulse_open(omap_device);
+    if (fd < 0) {
+        android_atomic_release_store(0, &omap_device->boost_last_ms);
+        return;
+    }
+
+    len = write(fd, "1", 1);
+    if (len < 0) {
+        strerror_r(errno, buf, sizeof(buf));
+        ALOGE("Error writing to %s: %s\n", BOOSTPULSE_PATH, buf);
+        android_atomic_release_store(0, &omap_device->boost_last_ms);
+        return;
+    }
+
+    android_atomic_inc(&omap_device->boosts_issued);
+    stats_latency(STATS_LATENCY_BOOST, &start);
+}
+
+/*
+ * Audio hints mostly come from the audio HAL's own instance of this
+ * module, in mediaserver, which has not been through omap_power_init().
+ * A boostpulse is safe from any process. The frequency caps are not: they
+ * belong to the profile stack of the instance that was initialized, so
+ * AUDIO_LOW_POWER only takes effect there, as the audio_low_power
+ * profile. Elsewhere it is dropped; screen-off playback is still capped
+ * by the screen_off profile.
+ */
+static void omap_power_audio_hint(struct omap_power_module *omap_device,
+                                  int hint, void *data) {
+    switch (hint) {
+    case OMAP_POWER_HINT_AUDIO_START:
+        boostpulse(omap_device);
+        break;
+
+    case OMAP_POWER_HINT_AUDIO_LOW_POWER:
+        if (!omap_device->inited)
+            break;
+
+        pthread_mutex_lock(&omap_device->lock);
+        set_mode(omap_device, MODE_AUDIO_LOW_POWER, data ? *(int *)data : 0, NULL);
+        pthread_mutex_unlock(&omap_device->lock);
+        break;
+    }
+}
+
+static void omap_power_mode_hint(struct omap_power_module *omap_device,
+                                 int hint, void *data, const struct timespec *start) {
+    int on = data ? *(int *)data : 1;
+
+    switch (hint) {
+    case OMAP_POWER_HINT_LAUNCH:
+        pthread_mutex_lock(&omap_device->lock);
+        if (on)
+            power_timer_arm(&omap_device->launch_timer, LAUNCH_BOOST_MS);
+        else
+            power_timer_cancel(&omap_device->launch_timer);
+        set_mode(omap_device, MODE_LAUNCH, on, start);
+        pthread_mutex_unlock(&omap_device->lock);
+        break;
+
+    case OMAP_POWER_HINT_SUSTAINED_PERFORMANCE:
+        pthread_mutex_lock(&omap_device->lock);
+        set_mode(omap_device, MODE_SUSTAINED, on, start);
+        pthread_mutex_unlock(&omap_device->lock);
+        break;
     }
 }
 
 static void omap_power_hint(struct power_module *module, power_hint_t hint, void *data) {
     struct omap_power_module *omap_device = (struct omap_power_module *) module;
-    char buf[80];
-    int len;
+    struct timespec start;
+
+    switch ((int)hint) {
+    case OMAP_POWER_HINT_AUDIO_START:
+    case OMAP_POWER_HINT_AUDIO_LOW_POWER:
+        omap_power_audio_hint(omap_device, hint, data);
+        return;
+    }
 
     if (!omap_device->inited)
         return;
 
+    if (hint != POWER_HINT_INTERACTION)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
     switch (hint) {
     case POWER_HINT_INTERACTION:
-        if (boostpulse_open(omap_device) >= 0) {
-            len = write(omap_device->boostpulse_fd, "1", 1);
-
-            if (len < 0) {
-                strerror_r(errno, buf, sizeof(buf));
-                ALOGE("Error writing to %s: %s\n", BOOSTPULSE_PATH, buf);
-            }
-        }
+        boostpulse(omap_device);
         break;
 
     case POWER_HINT_VSYNC:
+        vsync_hint(omap_device, data ? *(int *)data : 0, &start);
+        break;
+
+    case POWER_HINT_LOW_POWER:
+        pthread_mutex_lock(&omap_device->lock);
+        set_mode(omap_device, MODE_LOW_POWER, data ? *(int *)data : 0, &start);
+        pthread_mutex_unlock(&omap_device->lock);
         break;
 
     default:
+        omap_power_mode_hint(omap_device, hint, data, &start);
         break;
     }
 }
@@ -244,4 +558,8 @@ struct omap_power_module HAL_MODULE_INFO_SYM = {
     .lock = PTHREAD_MUTEX_INITIALIZER,
     .boostpulse_fd = -1,
     .boostpulse_warned = 0,
+    .boost_duration_ms = 0,
+    .boost_last_ms = 0,
+    .boosts_issued = 0,
+    .boosts_suppressed = 0,
 };
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+
+#include "profiles.h"
+
+/* Symbolic frequencies, resolved against the frequency table */
+#define FREQ_MIN (-2)
+#define FREQ_NOM (-3)
+#define FREQ_MAX (-4)
+
+static const char *profile_names[PROFILE_COUNT] = {
+    [PROFILE_INTERACTIVE] = "interactive",
+    [PROFILE_SCREEN_OFF] = "screen_off",
+    [PROFILE_SUSTAINED] = "sustained",
+    [PROFILE_VSYNC] = "vsync",
+    [PROFILE_LAUNCH] = "launch",
+    [PROFILE_AUDIO_LOW_POWER] = "audio_low_power",
+    [PROFILE_LOW_POWER] = "low_power",
+};
+
+static const struct {
+    const char *name;
+    enum tunable_id tunable;
+    int freq;
+} profile_keys[PROFILE_KEY_COUNT] = {
+    [PROFILE_TIMER_RATE] = { "timer_rate", TUNABLE_TIMER_RATE, 0 },
+    [PROFILE_MIN_SAMPLE_TIME] = { "min_sample_time", TUNABLE_MIN_SAMPLE_TIME, 0 },
+    [PROFILE_HISPEED_FREQ] = { "hispeed_freq", TUNABLE_HISPEED_FREQ, 1 },
+    [PROFILE_GO_HISPEED_LOAD] = { "go_hispeed_load", TUNABLE_GO_HISPEED_LOAD, 0 },
+    [PROFILE_ABOVE_HISPEED_DELAY] = { "above_hispeed_delay", TUNABLE_ABOVE_HISPEED_DELAY, 0 },
+    [PROFILE_MAX_FREQ] = { "max_freq", TUNABLE_SCALING_MAX_FREQ, 1 },
+    [PROFILE_MIN_FREQ] = { "min_freq", TUNABLE_SCALING_MIN_FREQ, 1 },
+};
+
+/*
+ * Used for the keys the file does not set. The interactive and screen_off
+ * ones are what the HAL did before there was a profile file.
+ */
+static const struct {
+    enum profile_id profile;
+    enum profile_key key;
+    int value;
+} profile_defaults[] = {
+    { PROFILE_INTERACTIVE, PROFILE_TIMER_RATE, 20000 },
+    { PROFILE_INTERACTIVE, PROFILE_MIN_SAMPLE_TIME, 60000 },
+    { PROFILE_INTERACTIVE, PROFILE_HISPEED_FREQ, FREQ_NOM },
+    { PROFILE_INTERACTIVE, PROFILE_GO_HISPEED_LOAD, 50 },
+    { PROFILE_INTERACTIVE, PROFILE_ABOVE_HISPEED_DELAY, 100000 },
+    { PROFILE_SCREEN_OFF, PROFILE_MAX_FREQ, FREQ_NOM },
+    { PROFILE_SUSTAINED, PROFILE_HISPEED_FREQ, FREQ_NOM },
+    { PROFILE_VSYNC, PROFILE_MIN_FREQ, FREQ_NOM },
+    { PROFILE_LAUNCH, PROFILE_HISPEED_FREQ, FREQ_MAX },
+    { PROFILE_LAUNCH, PROFILE_MIN_FREQ, FREQ_MAX },
+    { PROFILE_AUDIO_LOW_POWER, PROFILE_MAX_FREQ, FREQ_NOM },
+    { PROFILE_LOW_POWER, PROFILE_MAX_FREQ, FREQ_NOM },
+    { PROFILE_LOW_POWER, PROFILE_HISPEED_FREQ, FREQ_NOM },
+    { PROFILE_LOW_POWER, PROFILE_GO_HISPEED_LOAD, 90 },
+    { PROFILE_LOW_POWER, PROFILE_ABOVE_HISPEED_DELAY, 200000 },
+};
+
+int freq_table_load(struct freq_table *ft) {
+    char buf[MAX_FREQ_NUMBER * 10];
+    char *pos, *end;
+    int freq, i;
+
+    ft->num = 0;
+    if (tunable_read(TUNABLE_SCALING_AVAILABLE_FREQUENCIES, buf, sizeof(buf)) <= 0)
+        return -1;
+
+    for (pos = buf; ft->num < MAX_FREQ_NUMBER; pos = end) {
+        freq = strtol(pos, &end, 10);
+        if (end == pos)
+            break;
+        if (freq <= 0)
+            continue;
+
+        /* keep the table sorted */
+        for (i = ft->num; i > 0 && ft->freqs[i - 1] > freq; i--)
+            ft->freqs[i] = ft->freqs[i - 1];
+        ft->freqs[i] = freq;
+        ft->num++;
+    }
+
+    if (!ft->num)
+        return -1;
+
+    ft->max = ft->freqs[ft->num - 1];
+    ft->nom = ft->freqs[((NOM_FREQ_INDEX > ft->num) ? ft->num : NOM_FREQ_INDEX) - 1];
+
+    return 0;
+}
+
+/* Rounds freq down to an available frequency, or up to the lowest one */
+static int freq_resolve(const struct freq_table *ft, int freq) {
+    int i;
+
+    switch (freq) {
+    case FREQ_MIN:
+        return ft->freqs[0];
+    case FREQ_NOM:
+        return ft->nom;
+    case FREQ_MAX:
+        return ft->max;
+    }
+
+    for (i = ft->num - 1; i > 0 && ft->freqs[i] > freq; i--)
+        ;
+    return ft->freqs[i];
+}
+
+const char *profile_name(enum profile_id id) {
+    return profile_names[id];
+}
+
+enum tunable_id profile_key_tunable(enum profile_key key) {
+    return profile_keys[key].tunable;
+}
+
+void profile_merge(struct profile *to, const struct profile *over) {
+    int key;
+
+    for (key = 0; key < PROFILE_KEY_COUNT; key++)
+        if (over->values[key] != PROFILE_UNSET)
+            to->values[key] = over->values[key];
+}
+
+static char *trim(char *s) {
+    char *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+
+    return s;
+}
+
+static int parse_value(const char *s, int freq, int *value) {
+    char *end;
+    long v;
+
+    if (freq && !strcmp(s, "min")) {
+        *value = FREQ_MIN;
+    } else if (freq && !strcmp(s, "nom")) {
+        *value = FREQ_NOM;
+    } else if (freq && !strcmp(s, "max")) {
+        *value = FREQ_MAX;
+    } else {
+        v = strtol(s, &end, 10);
+        if (end == s || *end || v < 0)
+            return -EINVAL;
+        *value = v;
+    }
+
+    return 0;
+}
+
+static void profiles_parse(struct power_profiles *pp, FILE *f, const char *path) {
+    struct profile *profile = NULL;
+    char line[128];
+    char *s, *key, *value;
+    int lineno = 0;
+    int i, v;
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+
+        s = strchr(line, '#');
+        if (s)
+            *s = '\0';
+        s = trim(line);
+        if (!*s)
+            continue;
+
+        if (*s == '[') {
+            value = strchr(s, ']');
+            if (value)
+                *value = '\0';
+            profile = NULL;
+            for (i = 0; i < PROFILE_COUNT; i++)
+                if (!strcmp(s + 1, profile_names[i]))
+                    profile = &pp->profiles[i];
+            if (!profile)
+                ALOGW("%s:%d: unknown profile %s", path, lineno, s + 1);
+            continue;
+        }
+
+        value = strchr(s, '=');
+        if (!value) {
+            ALOGW("%s:%d: syntax error", path, lineno);
+            continue;
+        }
+        *value++ = '\0';
+        key = trim(s);
+        value = trim(value);
+
+        /* keys of unknown profiles were reported with the section */
+        if (!profile)
+            continue;
+
+        for (i = 0; i < PROFILE_KEY_COUNT; i++)
+            if (!strcmp(key, profile_keys[i].name))
+                break;
+        if (i == PROFILE_KEY_COUNT) {
+            ALOGW("%s:%d: unknown key %s", path, lineno, key);
+            continue;
+        }
+
+        if (parse_value(value, profile_keys[i].freq, &v)) {
+            ALOGW("%s:%d: bad value %s for %s", path, lineno, value, key);
+            continue;
+        }
+        profile->values[i] = v;
+    }
+}
+
+int profiles_load(struct power_profiles *pp, const char *path,
+                  const struct freq_table *ft) {
+    struct stat st;
+    FILE *f;
+    int ret = 0;
+    int i, key;
+
+    memset(pp, 0, sizeof(*pp));
+    for (i = 0; i < PROFILE_COUNT; i++)
+        for (key = 0; key < PROFILE_KEY_COUNT; key++)
+            pp->profiles[i].values[key] = PROFILE_UNSET;
+
+    for (i = 0; i < (int)(sizeof(profile_defaults) / sizeof(profile_defaults[0])); i++)
+        pp->profiles[profile_defaults[i].profile].values[profile_defaults[i].key] =
+                profile_defaults[i].value;
+
+    f = fopen(path, "r");
+    if (f) {
+        if (!fstat(fileno(f), &st)) {
+            pp->mtime = st.st_mtime;
+            pp->size = st.st_size;
+        }
+        profiles_parse(pp, f, path);
+        fclose(f);
+    } else {
+        ret = -errno;
+        ALOGW("Cannot read %s (%s), using built-in profiles", path, strerror(errno));
+    }
+
+    for (i = 0; i < PROFILE_COUNT; i++)
+        for (key = 0; key < PROFILE_KEY_COUNT; key++)
+            if (profile_keys[key].freq && pp->profiles[i].values[key] != PROFILE_UNSET)
+                pp->profiles[i].values[key] = freq_resolve(ft, pp->profiles[i].values[key]);
+
+    return ret;
+}
+
+int profiles_changed(const struct power_profiles *pp, const char *path) {
+    struct stat st;
+
+    if (stat(path, &st))
+        return pp->mtime != 0;
+
+    return st.st_mtime != pp->mtime || st.st_size != pp->size;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_PROFILES_H
+#define OMAP_POWER_PROFILES_H
+
+#include <sys/types.h>
+
+#include "tunables.h"
+
+#define PROFILES_PATH "/system/etc/power_profiles.conf"
+
+#define MAX_FREQ_NUMBER 16
+#define NOM_FREQ_INDEX 2
+
+/* scaling_available_frequencies, in kHz and ascending */
+struct freq_table {
+    int freqs[MAX_FREQ_NUMBER];
+    int num;
+    int nom; /* the NOM_FREQ_INDEX-th frequency, or the highest */
+    int max;
+};
+
+/* Returns 0, or -1 if the frequencies cannot be read */
+int freq_table_load(struct freq_table *ft);
+
+/*
+ * Governor profiles, each a set of interactive governor tunables and
+ * frequency caps. The interactive profile is the base; the others only
+ * override the keys they set.
+ *
+ * The profile file is an ini-style list of sections named after the
+ * profiles, holding "key = value" lines for the keys below; '#' starts a
+ * comment. Frequencies are in kHz, or one of min, nom and max, and are
+ * rounded down to an available frequency. Keys the file does not set keep
+ * their built-in defaults.
+ */
+
+enum profile_id {
+    PROFILE_INTERACTIVE,
+    PROFILE_SCREEN_OFF,
+    PROFILE_SUSTAINED,
+    PROFILE_VSYNC,
+    PROFILE_LAUNCH,
+    PROFILE_AUDIO_LOW_POWER,
+    PROFILE_LOW_POWER,
+    PROFILE_COUNT
+};
+
+enum profile_key {
+    PROFILE_TIMER_RATE,
+    PROFILE_MIN_SAMPLE_TIME,
+    PROFILE_HISPEED_FREQ,
+    PROFILE_GO_HISPEED_LOAD,
+    PROFILE_ABOVE_HISPEED_DELAY,
+    PROFILE_MAX_FREQ,
+    PROFILE_MIN_FREQ,
+    PROFILE_KEY_COUNT
+};
+
+#define PROFILE_UNSET (-1)
+
+struct profile {
+    int values[PROFILE_KEY_COUNT]; /* PROFILE_UNSET if not set */
+};
+
+struct power_profiles {
+    struct profile profiles[PROFILE_COUNT];
+    /* of the file loaded, to notice changes */
+    time_t mtime;
+    off_t size;
+};
+
+const char *profile_name(enum profile_id id);
+enum tunable_id profile_key_tunable(enum profile_key key);
+
+/* Sets the keys of over that are set in to */
+void profile_merge(struct profile *to, const struct profile *over);
+
+/*
+ * Loads the built-in defaults, then path over them. Returns 0, or -errno
+ * if path cannot be read, in which case only the defaults are loaded.
+ */
+int profiles_load(struct power_profiles *pp, const char *path,
+                  const struct freq_table *ft);
+
+/* Returns true if path is not the file pp was loaded from */
+int profiles_changed(const struct power_profiles *pp, const char *path);
+
+#endif /* OMAP_POWER_PROFILES_H */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+
+#include "profiles.h"
+#include "stats.h"
+#include "tunables.h"
+
+#define HISTORY_SIZE 16
+/* time_in_state counts in USER_HZ ticks */
+#define TICK_MS 10
+
+struct latency {
+    unsigned int count;
+    uint64_t total_us;
+    unsigned int max_us;
+};
+
+struct profile_switch {
+    struct timespec when;
+    const char *reason;
+    int screen_on;
+    int modes;
+    int thermal_steps;
+};
+
+static const char *latency_names[STATS_LATENCY_COUNT] = {
+    [STATS_LATENCY_BOOST] = "boost",
+    [STATS_LATENCY_PROFILE] = "profile",
+};
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct latency latencies[STATS_LATENCY_COUNT];
+static struct profile_switch history[HISTORY_SIZE];
+static unsigned int history_count;
+
+/* cpufreq residency, in ms: last reading, totals per screen state, current period */
+static int freqs[MAX_FREQ_NUMBER];
+static int num_freqs;
+static uint64_t last_ms[MAX_FREQ_NUMBER];
+static uint64_t residency_ms[2][MAX_FREQ_NUMBER];
+static uint64_t period_ms[MAX_FREQ_NUMBER];
+static int screen_on = 1;
+
+void stats_latency(enum stats_latency_id id, const struct timespec *start) {
+    struct latency *l = &latencies[id];
+    struct timespec now;
+    int64_t us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    us = (int64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+            (now.tv_nsec - start->tv_nsec) / 1000;
+
+    pthread_mutex_lock(&stats_lock);
+    l->count++;
+    l->total_us += us;
+    if (us > l->max_us)
+        l->max_us = us;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_profile_switch(const char *reason, int on, int modes, int thermal_steps) {
+    struct profile_switch *sw;
+
+    pthread_mutex_lock(&stats_lock);
+    sw = &history[history_count++ % HISTORY_SIZE];
+    clock_gettime(CLOCK_MONOTONIC, &sw->when);
+    sw->reason = reason;
+    sw->screen_on = on;
+    sw->modes = modes;
+    sw->thermal_steps = thermal_steps;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/* Charges the residency since the last reading to the current screen state */
+static void residency_update(void) {
+    char buf[MAX_FREQ_NUMBER * 24];
+    char *pos, *end;
+    long freq;
+    unsigned long long ticks;
+    int i;
+
+    if (tunable_read(TUNABLE_TIME_IN_STATE, buf, sizeof(buf)) <= 0)
+        return;
+
+    for (pos = buf; *pos; pos = end) {
+        freq = strtol(pos, &end, 10);
+        if (end == pos)
+            break;
+        ticks = strtoull(end, &end, 10);
+
+        for (i = 0; i < num_freqs && freqs[i] != freq; i++)
+            ;
+        if (i == num_freqs) {
+            if (num_freqs == MAX_FREQ_NUMBER)
+                continue;
+            freqs[num_freqs++] = freq;
+            /* no residency before the first reading */
+            last_ms[i] = ticks * TICK_MS;
+        }
+
+        residency_ms[screen_on][i] += ticks * TICK_MS - last_ms[i];
+        period_ms[i] += ticks * TICK_MS - last_ms[i];
+        last_ms[i] = ticks * TICK_MS;
+    }
+}
+
+void stats_screen_changed(int on) {
+    uint64_t total = 0, weighted = 0, at_max = 0;
+    int i, max = 0;
+
+    pthread_mutex_lock(&stats_lock);
+
+    residency_update();
+
+    for (i = 0; i < num_freqs; i++) {
+        total += period_ms[i];
+        weighted += period_ms[i] * freqs[i];
+        if (freqs[i] > freqs[max])
+            max = i;
+    }
+    if (num_freqs)
+        at_max = period_ms[max];
+    if (total)
+        ALOGI("Screen %s for %llu s: average %llu kHz, %llu%% at %d kHz",
+              screen_on ? "on" : "off", (unsigned long long)(total / 1000),
+              (unsigned long long)(weighted / total),
+              (unsigned long long)(at_max * 100 / total), freqs[max]);
+
+    memset(period_ms, 0, sizeof(period_ms));
+    screen_on = on;
+
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_dump(int fd) {
+    struct profile_switch *sw;
+    struct latency *l;
+    unsigned int i, first;
+    int on;
+
+    pthread_mutex_lock(&stats_lock);
+
+    residency_update();
+    dprintf(fd, "cpufreq residency (ms):\n%10s %12s %12s\n", "kHz", "screen on", "screen off");
+    for (i = 0; i < (unsigned int)num_freqs; i++)
+        dprintf(fd, "%10d %12llu %12llu\n", freqs[i],
+                (unsigned long long)residency_ms[1][i],
+                (unsigned long long)residency_ms[0][i]);
+
+    dprintf(fd, "\nlatency (us):\n");
+    for (i = 0; i < STATS_LATENCY_COUNT; i++) {
+        l = &latencies[i];
+        dprintf(fd, "  %-8s count %u avg %llu max %u\n", latency_names[i], l->count,
+                l->count ? (unsigned long long)(l->total_us / l->count) : 0ULL, l->max_us);
+    }
+
+    dprintf(fd, "\nprofile switches (%u, last %d):\n", history_count, HISTORY_SIZE);
+    first = (history_count > HISTORY_SIZE) ? history_count - HISTORY_SIZE : 0;
+    for (i = first; i < history_count; i++) {
+        sw = &history[i % HISTORY_SIZE];
+        on = sw->screen_on;
+        dprintf(fd, "  %5ld.%03ld %-10s screen %s modes 0x%x thermal -%d\n",
+                (long)sw->when.tv_sec, sw->when.tv_nsec / 1000000, sw->reason,
+                on ? "on " : "off", sw->modes, sw->thermal_steps);
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_STATS_H
+#define OMAP_POWER_STATS_H
+
+#include <time.h>
+
+/*
+ * Power HAL statistics: cpufreq residency split by screen state, hint to
+ * sysfs write latencies and a history of profile switches. power.c adds
+ * its own counters and writes everything to STATS_PATH on every screen
+ * state change.
+ */
+
+#define STATS_PATH "/data/system/power_stats.txt"
+
+enum stats_latency_id {
+    STATS_LATENCY_BOOST,   /* interaction or touch to boostpulse written */
+    STATS_LATENCY_PROFILE, /* hint or screen change to profile written */
+    STATS_LATENCY_COUNT
+};
+
+/* Accounts the time from start, a CLOCK_MONOTONIC time, to now */
+void stats_latency(enum stats_latency_id id, const struct timespec *start);
+
+/* Records a profile switch in the history */
+void stats_profile_switch(const char *reason, int screen_on, int modes, int thermal_steps);
+
+/*
+ * Charges the cpufreq residency since the last call to the screen state
+ * that is ending, and logs a summary of it.
+ */
+void stats_screen_changed(int on);
+
+void stats_dump(int fd);
+
+#endif /* OMAP_POWER_STATS_H */
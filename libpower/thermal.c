@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+
+#include "thermal.h"
+#include "timer.h"
+#include "tunables.h"
+
+#define MAX_THERMAL_ZONES 8
+
+#define THERMAL_SAMPLE_MS 1000
+/* in millidegrees Celsius; OMAP4 kernels start throttling around 85 C */
+#define THERMAL_START_MC 75000
+#define THERMAL_STEP_MC 3000
+#define THERMAL_HYST_MC 2000
+
+static pthread_mutex_t thermal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t thermal_once = PTHREAD_ONCE_INIT;
+static struct power_timer thermal_timer;
+static int zone_fds[MAX_THERMAL_ZONES];
+static int num_zones;
+static int running;
+static int steps;
+static thermal_fn notify;
+static void *notify_arg;
+
+static void thermal_sample(void *arg);
+
+static void thermal_init(void) {
+    char buf[PATH_MAX];
+    char path[PATH_MAX];
+    const char *root;
+    struct dirent *de;
+    DIR *dir;
+    int fd;
+
+    power_timer_init(&thermal_timer, thermal_sample, NULL);
+
+    root = power_path(THERMAL_ROOT, buf, sizeof(buf));
+    dir = opendir(root);
+    if (!dir) {
+        ALOGW("No thermal zones, thermal capping disabled");
+        return;
+    }
+
+    while ((de = readdir(dir)) && num_zones < MAX_THERMAL_ZONES) {
+        if (strncmp(de->d_name, "thermal_zone", 12))
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s/temp", root, de->d_name);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+            zone_fds[num_zones++] = fd;
+    }
+
+    closedir(dir);
+}
+
+/* Returns the hottest zone, in millidegrees, or INT_MIN */
+static int thermal_read(void) {
+    char buf[16];
+    int i, len, temp, max = INT_MIN;
+
+    for (i = 0; i < num_zones; i++) {
+        len = pread(zone_fds[i], buf, sizeof(buf) - 1, 0);
+        if (len <= 0)
+            continue;
+        buf[len] = '\0';
+        temp = atoi(buf);
+        /* some drivers report whole degrees */
+        if (temp > -1000 && temp < 1000)
+            temp *= 1000;
+        if (temp > max)
+            max = temp;
+    }
+
+    return max;
+}
+
+static void thermal_sample(void *arg __unused) {
+    thermal_fn fn = NULL;
+    void *fn_arg = NULL;
+    int temp, target, n = 0;
+
+    pthread_mutex_lock(&thermal_lock);
+    if (!running) {
+        pthread_mutex_unlock(&thermal_lock);
+        return;
+    }
+
+    temp = thermal_read();
+    target = (temp >= THERMAL_START_MC) ? (temp - THERMAL_START_MC) / THERMAL_STEP_MC + 1 : 0;
+
+    if (target > steps ||
+            (target < steps &&
+             temp < THERMAL_START_MC + (steps - 1) * THERMAL_STEP_MC - THERMAL_HYST_MC)) {
+        n = (target > steps) ? target : steps - 1;
+        ALOGV("%d.%03d C, %d frequency steps down", temp / 1000, temp % 1000, n);
+        steps = n;
+        fn = notify;
+        fn_arg = notify_arg;
+    }
+
+    power_timer_arm(&thermal_timer, THERMAL_SAMPLE_MS);
+    pthread_mutex_unlock(&thermal_lock);
+
+    /* without our lock, the callback takes the module lock */
+    if (fn)
+        fn(n, fn_arg);
+}
+
+void thermal_start(thermal_fn fn, void *arg) {
+    pthread_once(&thermal_once, thermal_init);
+
+    pthread_mutex_lock(&thermal_lock);
+    if (num_zones && !running) {
+        notify = fn;
+        notify_arg = arg;
+        running = 1;
+        power_timer_arm(&thermal_timer, 0);
+    }
+    pthread_mutex_unlock(&thermal_lock);
+}
+
+/* The cap in force stays until the next start samples again */
+void thermal_stop(void) {
+    pthread_mutex_lock(&thermal_lock);
+    running = 0;
+    power_timer_cancel(&thermal_timer);
+    pthread_mutex_unlock(&thermal_lock);
+}
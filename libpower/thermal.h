@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_THERMAL_H
+#define OMAP_POWER_THERMAL_H
+
+#define THERMAL_ROOT "/sys/class/thermal"
+
+/*
+ * Soft thermal capping, ahead of the kernel's hard throttling.
+ *
+ * The hottest thermal zone is sampled every THERMAL_SAMPLE_MS while
+ * running. From THERMAL_START_MC on, every THERMAL_STEP_MC costs one
+ * frequency step; steps are taken at once and given back one at a time,
+ * THERMAL_HYST_MC below the temperature that took them.
+ */
+
+/* Called from the timer thread with the new number of steps to drop */
+typedef void (*thermal_fn)(int steps, void *arg);
+
+void thermal_start(thermal_fn fn, void *arg);
+void thermal_stop(void);
+
+#endif /* OMAP_POWER_THERMAL_H */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+
+#include "timer.h"
+
+static pthread_mutex_t timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timers_cond;
+static pthread_once_t timers_once = PTHREAD_ONCE_INIT;
+static struct power_timer *timers; /* armed, by deadline */
+static int timers_running;
+
+static int ts_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* must be called with timers_lock held */
+static void timer_unlink(struct power_timer *timer) {
+    struct power_timer **t;
+
+    for (t = &timers; *t; t = &(*t)->next) {
+        if (*t == timer) {
+            *t = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->armed = 0;
+}
+
+static void *timer_thread(void *arg __unused) {
+    struct power_timer *timer;
+    struct timespec now;
+
+    pthread_mutex_lock(&timers_lock);
+    for (;;) {
+        if (!timers) {
+            pthread_cond_wait(&timers_cond, &timers_lock);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (ts_before(&now, &timers->deadline)) {
+            pthread_cond_timedwait(&timers_cond, &timers_lock, &timers->deadline);
+            continue;
+        }
+
+        timer = timers;
+        timer_unlink(timer);
+
+        pthread_mutex_unlock(&timers_lock);
+        timer->fn(timer->arg);
+        pthread_mutex_lock(&timers_lock);
+    }
+
+    return NULL;
+}
+
+static void timers_start(void) {
+    pthread_condattr_t attr;
+    pthread_attr_t thread_attr;
+    pthread_t thread;
+    int ret;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timers_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_attr_init(&thread_attr);
+    pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &thread_attr, timer_thread, NULL);
+    pthread_attr_destroy(&thread_attr);
+
+    if (ret)
+        ALOGE("Cannot start timer thread: %s", strerror(ret));
+    else
+        timers_running = 1;
+}
+
+void power_timer_init(struct power_timer *timer, void (*fn)(void *arg), void *arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+void power_timer_arm(struct power_timer *timer, int ms) {
+    struct power_timer **t;
+
+    pthread_once(&timers_once, timers_start);
+    if (!timers_running)
+        return;
+
+    pthread_mutex_lock(&timers_lock);
+
+    if (timer->armed)
+        timer_unlink(timer);
+
+    clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+    timer->deadline.tv_sec += ms / 1000;
+    timer->deadline.tv_nsec += (ms % 1000) * 1000000L;
+    if (timer->deadline.tv_nsec >= 1000000000L) {
+        timer->deadline.tv_sec++;
+        timer->deadline.tv_nsec -= 1000000000L;
+    }
+
+    for (t = &timers; *t && !ts_before(&timer->deadline, &(*t)->deadline); t = &(*t)->next)
+        ;
+    timer->next = *t;
+    *t = timer;
+    timer->armed = 1;
+
+    /* the thread only needs waking if the earliest deadline moved */
+    if (timers == timer)
+        pthread_cond_signal(&timers_cond);
+
+    pthread_mutex_unlock(&timers_lock);
+}
+
+void power_timer_cancel(struct power_timer *timer) {
+    pthread_mutex_lock(&timers_lock);
+    if (timer->armed)
+        timer_unlink(timer);
+    pthread_mutex_unlock(&timers_lock);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_TIMER_H
+#define OMAP_POWER_TIMER_H
+
+#include <time.h>
+
+/*
+ * One-shot timers, all run by a single worker thread started on first
+ * use. Callbacks run on that thread with no timer lock held, so they may
+ * take other locks and re-arm timers.
+ *
+ * A callback can still run once after power_timer_cancel() if it was
+ * already due; callbacks must check under their own lock that what they
+ * were armed for still holds.
+ */
+
+struct power_timer {
+    void (*fn)(void *arg);
+    void *arg;
+    struct timespec deadline; /* CLOCK_MONOTONIC */
+    int armed;
+    struct power_timer *next;
+};
+
+void power_timer_init(struct power_timer *timer, void (*fn)(void *arg), void *arg);
+
+/* Runs the callback in ms; re-arming an armed timer moves its deadline */
+void power_timer_arm(struct power_timer *timer, int ms);
+
+void power_timer_cancel(struct power_timer *timer);
+
+#endif /* OMAP_POWER_TIMER_H */
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+#include <cutils/properties.h>
+
+#include "touch_boost.h"
+
+#define INPUT_DIR "/dev/input"
+#define MAX_TOUCH_DEVICES 4
+#define EVENT_BATCH 64
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NLONGS(x) (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+struct touch_device {
+    int fd;
+    int down; /* contacts currently down */
+};
+
+static struct touch_device devices[MAX_TOUCH_DEVICES];
+static int num_devices;
+static int epoll_fd = -1;
+static touch_boost_fn boost_fn;
+static void *boost_arg;
+
+/* Same test the framework uses for a touchscreen: direct multi-touch */
+static int is_touchscreen(int fd) {
+    unsigned long ev_bits[NLONGS(EV_MAX + 1)];
+    unsigned long abs_bits[NLONGS(ABS_MAX + 1)];
+    unsigned long prop_bits[NLONGS(INPUT_PROP_MAX + 1)];
+
+    memset(ev_bits, 0, sizeof(ev_bits));
+    memset(abs_bits, 0, sizeof(abs_bits));
+    memset(prop_bits, 0, sizeof(prop_bits));
+
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits) < 0 ||
+            !TEST_BIT(EV_ABS, ev_bits))
+        return 0;
+
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) < 0 ||
+            !TEST_BIT(ABS_MT_POSITION_X, abs_bits))
+        return 0;
+
+    /* older drivers do not report properties; assume direct */
+    if (ioctl(fd, EVIOCGPROP(sizeof(prop_bits)), prop_bits) >= 0 &&
+            TEST_BIT(INPUT_PROP_POINTER, prop_bits))
+        return 0;
+
+    return 1;
+}
+
+static int open_touch_devices(void) {
+    char path[PATH_MAX];
+    char name[80];
+    struct dirent *de;
+    DIR *dir;
+    int fd;
+
+    dir = opendir(INPUT_DIR);
+    if (!dir)
+        return -errno;
+
+    while ((de = readdir(dir)) && num_devices < MAX_TOUCH_DEVICES) {
+        if (strncmp(de->d_name, "event", 5))
+            continue;
+
+        snprintf(path, sizeof(path), INPUT_DIR "/%s", de->d_name);
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+
+        if (!is_touchscreen(fd)) {
+            close(fd);
+            continue;
+        }
+
+        name[0] = '\0';
+        ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+        ALOGI("Touch boost on %s (%s)", path, name);
+
+        devices[num_devices].fd = fd;
+        devices[num_devices].down = 0;
+        num_devices++;
+    }
+
+    closedir(dir);
+    return num_devices ? 0 : -ENODEV;
+}
+
+/*
+ * Returns true on the first contact of a gesture. Type B drivers report
+ * contacts by tracking id, type A ones (and single touch) by BTN_TOUCH.
+ */
+static int touch_down(struct touch_device *dev, const struct input_event *ev) {
+    if (ev->type == EV_KEY && ev->code == BTN_TOUCH) {
+        if (ev->value)
+            return !dev->down++;
+        dev->down = 0;
+    } else if (ev->type == EV_ABS && ev->code == ABS_MT_TRACKING_ID) {
+        if (ev->value >= 0)
+            return !dev->down++;
+        if (dev->down > 0)
+            dev->down--;
+    }
+
+    return 0;
+}
+
+static void *touch_boost_thread(void *arg __unused) {
+    struct input_event events[EVENT_BATCH];
+    struct epoll_event ready[MAX_TOUCH_DEVICES];
+    struct touch_device *dev;
+    ssize_t len;
+    int n, i, j, boost;
+
+    for (;;) {
+        n = epoll_wait(epoll_fd, ready, MAX_TOUCH_DEVICES, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("Touch boost: epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            dev = (struct touch_device *)ready[i].data.ptr;
+            boost = 0;
+
+            while ((len = read(dev->fd, events, sizeof(events))) > 0) {
+                for (j = 0; j < (int)(len / sizeof(events[0])); j++)
+                    boost |= touch_down(dev, &events[j]);
+            }
+
+            if (boost)
+                boost_fn(boost_arg);
+        }
+    }
+
+    return NULL;
+}
+
+int touch_boost_start(touch_boost_fn boost, void *arg) {
+    char value[PROPERTY_VALUE_MAX];
+    struct epoll_event ev;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret, i;
+
+    if (property_get("ro.power.touch_boost", value, "0") <= 0 || !atoi(value))
+        return -ENODEV;
+
+    ret = open_touch_devices();
+    if (ret) {
+        ALOGW("Touch boost: no touchscreen found");
+        return ret;
+    }
+
+    boost_fn = boost;
+    boost_arg = arg;
+
+    epoll_fd = epoll_create(MAX_TOUCH_DEVICES);
+    if (epoll_fd < 0) {
+        ret = -errno;
+        goto fail;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &devices[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, devices[i].fd, &ev) < 0) {
+            ret = -errno;
+            goto fail;
+        }
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = -pthread_create(&thread, &attr, touch_boost_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret)
+        goto fail;
+
+    return 0;
+
+fail:
+    ALOGE("Touch boost: cannot start: %s", strerror(-ret));
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    epoll_fd = -1;
+    for (i = 0; i < num_devices; i++)
+        close(devices[i].fd);
+    num_devices = 0;
+    return ret;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_TOUCH_BOOST_H
+#define OMAP_POWER_TOUCH_BOOST_H
+
+/*
+ * Boosts straight from the touchscreen's evdev node, ahead of the
+ * POWER_HINT_INTERACTION the framework sends once the input pipeline has
+ * dispatched the event.
+ *
+ * A thread watches every direct-touch input device and calls boost on
+ * the first finger down of each gesture. It is enabled with the
+ * ro.power.touch_boost property.
+ */
+
+typedef void (*touch_boost_fn)(void *arg);
+
+/*
+ * Starts the thread if enabled and a touchscreen is found. Returns 0 if
+ * started, -ENODEV if there is no touchscreen or touch boost is disabled,
+ * or -errno.
+ */
+int touch_boost_start(touch_boost_fn boost, void *arg);
+
+#endif /* OMAP_POWER_TOUCH_BOOST_H */
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "TI OMAP PowerHAL"
+#include <utils/Log.h>
+
+#include "tunables.h"
+
+/* Longest value we cache; longer ones are always written */
+#define TUNABLE_VALUE_MAX 16
+
+struct tunable {
+    const char *path;
+    int flags;
+    int fd;
+    int warned;
+    char value[TUNABLE_VALUE_MAX]; /* "" when unknown */
+};
+
+static struct tunable tunables[TUNABLE_COUNT] = {
+    [TUNABLE_SCALING_MAX_FREQ] = { CPUFREQ_CPU0 "scaling_max_freq", O_RDWR, -1, 0, "" },
+    [TUNABLE_SCALING_MIN_FREQ] = { CPUFREQ_CPU0 "scaling_min_freq", O_RDWR, -1, 0, "" },
+    [TUNABLE_SCALING_AVAILABLE_FREQUENCIES] = {
+            CPUFREQ_CPU0 "scaling_available_frequencies", O_RDONLY, -1, 0, "" },
+    [TUNABLE_TIMER_RATE] = { CPUFREQ_INTERACTIVE "timer_rate", O_WRONLY, -1, 0, "" },
+    [TUNABLE_MIN_SAMPLE_TIME] = { CPUFREQ_INTERACTIVE "min_sample_time", O_WRONLY, -1, 0, "" },
+    [TUNABLE_HISPEED_FREQ] = { CPUFREQ_INTERACTIVE "hispeed_freq", O_WRONLY, -1, 0, "" },
+    [TUNABLE_GO_HISPEED_LOAD] = { CPUFREQ_INTERACTIVE "go_hispeed_load", O_WRONLY, -1, 0, "" },
+    [TUNABLE_ABOVE_HISPEED_DELAY] = {
+            CPUFREQ_INTERACTIVE "above_hispeed_delay", O_WRONLY, -1, 0, "" },
+    [TUNABLE_BOOSTPULSE_DURATION] = {
+            CPUFREQ_INTERACTIVE "boostpulse_duration", O_RDONLY, -1, 0, "" },
+    [TUNABLE_CPU1_ONLINE] = { CPU1_ONLINE, O_WRONLY, -1, 0, "" },
+    [TUNABLE_TIME_IN_STATE] = { CPUFREQ_CPU0 "stats/time_in_state", O_RDONLY, -1, 0, "" },
+};
+
+static pthread_mutex_t tunables_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t root_once = PTHREAD_ONCE_INIT;
+static const char *root = "";
+
+static void root_init(void) {
+    const char *env = getenv(POWER_HAL_ROOT_ENV);
+
+    if (env && env[0]) {
+        root = env;
+        ALOGI("Using %s as the root", root);
+    }
+}
+
+const char *power_path(const char *path, char *buf, size_t size) {
+    pthread_once(&root_once, root_init);
+
+    if (!root[0])
+        return path;
+
+    snprintf(buf, size, "%s%s", root, path);
+    return buf;
+}
+
+const char *tunable_path(enum tunable_id id) {
+    return tunables[id].path;
+}
+
+/* must be called with tunables_lock held */
+static int tunable_open(struct tunable *t) {
+    char path[PATH_MAX];
+    char buf[80];
+
+    if (t->fd >= 0)
+        return t->fd;
+
+    t->fd = open(power_path(t->path, path, sizeof(path)), t->flags);
+    if (t->fd < 0 && !t->warned) {
+        /* opened on every access until it works, but only reported once */
+        strerror_r(errno, buf, sizeof(buf));
+        ALOGE("Error opening %s: %s\n", t->path, buf);
+        t->warned = 1;
+    }
+
+    return t->fd;
+}
+
+int tunable_write(enum tunable_id id, const char *value) {
+    struct tunable *t = &tunables[id];
+    size_t len = strlen(value);
+    char buf[80];
+    int ret = 0;
+
+    pthread_mutex_lock(&tunables_lock);
+
+    if (t->value[0] && !strcmp(t->value, value)) {
+        ret = 1;
+        goto exit;
+    }
+
+    if (tunable_open(t) < 0) {
+        ret = -errno;
+        goto exit;
+    }
+
+    if (pwrite(t->fd, value, len, 0) < 0) {
+        ret = -errno;
+        strerror_r(errno, buf, sizeof(buf));
+        ALOGE("Error writing to %s: %s\n", t->path, buf);
+        t->value[0] = '\0';
+        goto exit;
+    }
+
+    if (len < sizeof(t->value))
+        strcpy(t->value, value);
+    else
+        t->value[0] = '\0';
+
+exit:
+    pthread_mutex_unlock(&tunables_lock);
+    return ret;
+}
+
+int tunable_read(enum tunable_id id, char *s, size_t size) {
+    struct tunable *t = &tunables[id];
+    char buf[80];
+    int len;
+
+    if (!s || !size)
+        return -EINVAL;
+
+    pthread_mutex_lock(&tunables_lock);
+
+    if (tunable_open(t) < 0) {
+        len = -errno;
+        goto exit;
+    }
+
+    len = pread(t->fd, s, size - 1, 0);
+    if (len < 0) {
+        len = -errno;
+        strerror_r(errno, buf, sizeof(buf));
+        ALOGE("Error reading from %s: %s\n", t->path, buf);
+        goto exit;
+    }
+
+    while (len > 0 && s[len - 1] == '\n')
+        len--;
+    s[len] = '\0';
+
+    if ((size_t)len < sizeof(t->value))
+        strcpy(t->value, s);
+    else
+        t->value[0] = '\0';
+
+exit:
+    pthread_mutex_unlock(&tunables_lock);
+    return len;
+}
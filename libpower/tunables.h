@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP_POWER_TUNABLES_H
+#define OMAP_POWER_TUNABLES_H
+
+#include <stddef.h>
+
+#define CPUFREQ_INTERACTIVE "/sys/devices/system/cpu/cpufreq/interactive/"
+#define CPUFREQ_CPU0 "/sys/devices/system/cpu/cpu0/cpufreq/"
+#define CPU1_ONLINE "/sys/devices/system/cpu/cpu1/online"
+
+/*
+ * Registry of the sysfs nodes the power HAL touches. Each node is opened
+ * on first use and the fd is kept for the life of the process; reads and
+ * writes go through pread()/pwrite() at offset 0, which sysfs treats as a
+ * fresh show()/store().
+ *
+ * The last value read or written is cached per node, and writes of that
+ * same value are skipped. A value changed behind our back is only noticed
+ * on the next read of the node.
+ */
+
+enum tunable_id {
+    TUNABLE_SCALING_MAX_FREQ,
+    TUNABLE_SCALING_MIN_FREQ,
+    TUNABLE_SCALING_AVAILABLE_FREQUENCIES,
+    TUNABLE_TIMER_RATE,
+    TUNABLE_MIN_SAMPLE_TIME,
+    TUNABLE_HISPEED_FREQ,
+    TUNABLE_GO_HISPEED_LOAD,
+    TUNABLE_ABOVE_HISPEED_DELAY,
+    TUNABLE_BOOSTPULSE_DURATION,
+    TUNABLE_CPU1_ONLINE,
+    TUNABLE_TIME_IN_STATE,
+    TUNABLE_COUNT
+};
+
+/*
+ * Everything the HAL opens lives under a root directory, the real root on
+ * the device. The host replay harness points POWER_HAL_ROOT at a fake tree.
+ */
+#define POWER_HAL_ROOT_ENV "POWER_HAL_ROOT"
+
+/* Returns path under the root, formatted into buf if there is one */
+const char *power_path(const char *path, char *buf, size_t size);
+
+/* Returns the sysfs path of a tunable, for logging */
+const char *tunable_path(enum tunable_id id);
+
+/*
+ * Writes value unless it is the cached one. Returns 1 if the write was
+ * skipped, 0 on success, or -errno.
+ */
+int tunable_write(enum tunable_id id, const char *value);
+
+/*
+ * Reads the node into s, NUL terminated and without the trailing
+ * newline. Returns the length read or -errno.
+ */
+int tunable_read(enum tunable_id id, char *s, size_t size);
+
+#endif /* OMAP_POWER_TUNABLES_H */